@@ -8,59 +8,178 @@
 #include <chrono>
 #include <iomanip>
 #include <ctime>
+#include <thread>
+#include <atomic>
+#include <numeric>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <list>
+#include <cctype>
 #include <boost/nowide/args.hpp>
 #include <boost/nowide/cstdlib.hpp>
 #include <boost/nowide/fstream.hpp>
 #include <boost/nowide/iostream.hpp>
 #include <boost/program_options.hpp>
-#include <boost/tokenizer.hpp>
 #include <boost/predef.h>
 #include <boost/version.hpp>
-#include "embed_resources.h"
+#if BOOST_OS_UNIX
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#if BOOST_OS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+#include "dompdfui_internal.h"
+#include "pdf_merge.h"
 #include "timestamp.h"
 
 namespace po = boost::program_options;
 namespace fs = std::filesystem ;
 namespace nw = boost::nowide;
+using namespace dompdfui;
 
 
 std::tuple<int, std::vector<fs::path>, std::vector<fs::path>, po::variables_map> parse_cli_args(int argc, char** argv) ;
-void extract_embedded_resources(const po::variables_map&) ;
+po::options_description dompdf_options() ;
+Options library_options(const po::variables_map&) ;
 void html2pdf(const std::vector<fs::path>&, const std::vector<fs::path>&, const po::variables_map&) ;
-fs::path temp_path() ;
+void serve(const po::variables_map&) ;
+void html2pdf_client(const std::vector<fs::path>&, const std::vector<fs::path>&, const po::variables_map&) ;
+void html2pdf_stream(const std::vector<fs::path>&, const po::variables_map&) ;
+void register_fonts(const po::variables_map&) ;
+std::string option_value_str(const po::variable_value&) ;
 
 
 bool cleanup_on_exit {};
+bool stdout_is_output {};
+fs::path journal_path;    // journal of converted documents, if --incremental, --resume or --journal is given
 int return_code {};
+double extraction_time {};  // seconds spent on extraction of embedded resources
 
 
 int main(int argc, char** argv)
 {
   try {
+#if BOOST_OS_WINDOWS
     if(!nw::system(nullptr))
       throw std::runtime_error("the command processor is not exists");
+#endif
     nw::args utf8_args (argc, argv);
     auto [parse_result, in_files, out_files, opts] = parse_cli_args(argc, argv) ;
     if( parse_result!=1 ) {
       return_code = parse_result ;
+    } else if( opts.count("register-fonts") ) {
+      extract_embedded_resources(library_options(opts));
+      register_fonts(opts);
+    } else if( opts.count("serve") ) {
+      extract_embedded_resources(library_options(opts));
+      serve(opts);
+    } else if( opts.count("client") ) {
+      html2pdf_client(in_files, out_files, opts);
+    } else if( stdout_is_output ) {
+      extract_embedded_resources(library_options(opts));
+      html2pdf_stream(in_files, opts);
     } else {
-      extract_embedded_resources(opts);
+      auto start = std::chrono::steady_clock::now();
+      extract_embedded_resources(library_options(opts));
+      extraction_time = seconds_since(start);
       html2pdf(in_files, out_files, opts);
     }
   }
   catch (const std::exception& e) {
-    nw::cout << "Error: " << e.what() << '\n';
+    nw::cerr << "Error: " << e.what() << '\n';
     return_code = -1;
   }
   catch (...) {
-    nw::cout << "Error: Unknown exception\n" ;
+    nw::cerr << "Error: Unknown exception\n" ;
     return_code = -1;
   }
-  if (cleanup_on_exit) fs::remove_all(temp_path());
+  if (cleanup_on_exit) remove_runtime();
   return return_code;
 }
 
 
+// function return description of options passed to Dompdf library
+po::options_description dompdf_options()
+{
+  po::options_description dopts("DomPdf Options");
+  dopts.add_options()
+      ("isPhpEnabled", po::value<bool>()->default_value(false))
+      ("isRemoteEnabled", po::value<bool>()->default_value(false))
+      ("isPdfAEnabled", po::value<bool>()->default_value(false))
+      ("isJavascriptEnabled", po::value<bool>()->default_value(true))
+      ("isHtml5ParserEnabled", po::value<bool>()->default_value(true))
+      ("isFontSubsettingEnabled", po::value<bool>()->default_value(true))
+      ("sslAllowSelfSigned", po::value<bool>()->default_value(true))
+      ("debugPng", po::value<bool>()->default_value(false))
+      ("debugKeepTemp", po::value<bool>()->default_value(false))
+      ("debugCss", po::value<bool>()->default_value(false))
+      ("debugLayout", po::value<bool>()->default_value(false))
+      ("debugLayoutLines", po::value<bool>()->default_value(true))
+      ("debugLayoutBlocks", po::value<bool>()->default_value(true))
+      ("debugLayoutInline", po::value<bool>()->default_value(true))
+      ("debugLayoutPaddingBox", po::value<bool>()->default_value(true))
+      ("dpi", po::value<std::string>()->default_value("96"))
+      ("fontHeightRatio", po::value<std::string>()->default_value("1.1"))
+      ("rootDir", po::value<std::string>())
+      ("tempDir", po::value<std::string>())
+      ("fontDir", po::value<std::string>())
+      ("fontCache", po::value<std::string>())
+      ("logOutputFile", po::value<std::string>())
+      ("defaultMediaType", po::value<std::string>()->default_value("screen"))
+      ("defaultPaperSize", po::value<std::string>()->default_value("a4"))
+      ("defaultPaperOrientation", po::value<std::string>()->default_value("portrait"))
+      ("defaultFont", po::value<std::string>()->default_value("dejavu serif"))
+      ("pdfBackend", po::value<std::string>()->default_value("CPDF"))
+      ("pdflibLicense", po::value<std::string>())
+      ("chroot", po::value<std::vector<std::string>>())
+      ("allowedRemoteHosts", po::value<std::vector<std::string>>())
+      ;
+  return dopts;
+}
+
+
+// function return options of dompdfui library, set from command line
+Options library_options(const po::variables_map& opts)
+{
+  Options r;
+  auto dopts = dompdf_options();
+  for(const auto& o: dopts.options()) {
+    const auto& name = o->long_name();
+    if(opts.count(name)) set_option(r, name, option_value_str(opts[name]));
+  }
+  r.jobs = std::max(1u, opts["jobs"].as<unsigned>());
+  r.batch_size = opts["batch-size"].as<unsigned>();
+  r.max_queue = opts["max-queue"].as<unsigned>();
+  r.php_memory_limit = opts["php-memory-limit"].as<unsigned long long>();
+  r.opcache = opts["opcache"].as<bool>();
+  r.php_in_memory = opts["php-in-memory"].as<bool>();
+  r.no_zip_copy = opts["no-zip-copy"].as<bool>();
+  if(opts.count("cache-dir")) r.cache_dir = opts["cache-dir"].as<std::string>();
+  r.cache_size = opts["cache-size"].as<unsigned long long>();
+  if(opts.count("asset-cache")) r.asset_cache = opts["asset-cache"].as<std::string>();
+  r.asset_connections = opts["asset-connections"].as<unsigned>();
+  if(opts.count("image-cache")) r.image_cache = opts["image-cache"].as<std::string>();
+  r.image_quality = opts["image-quality"].as<unsigned>();
+  r.split_size = opts["split-size"].as<unsigned long long>();
+  return r;
+}
+
+
 // function return 4 values:
 //     first is a cli parser result: 1 = OK; 0 = Help; -1 = parser error
 //     second  - array of input files
@@ -81,46 +200,41 @@ std::tuple<int, std::vector<fs::path>, std::vector<fs::path>, po::variables_map>
     po::options_description popts("Program Options");
     popts.add_options()
         ("php-memory-limit,m", po::value<unsigned long long>()->default_value(268435456), "Limits the amount of memory (in bytes) a php-cli can use.")
+        ("jobs,j", po::value<unsigned>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "number of php-cli processes running at the same time")
+        ("batch-size,b", po::value<unsigned>()->default_value(20), "maximum number of files converted by one php-cli process before it is restarted")
+        ("max-total-memory", po::value<unsigned long long>()->default_value(0), "limits the total memory (in bytes) of php-cli processes running at the same time; each process gets a memory limit estimated from sizes of its files and past runs")
+        ("memory-state", po::value<std::string>(), "file, where peak memory of converted files is kept between runs for --max-total-memory; default is dompdfui_memory.state in temp directory")
         ("version,v", "print version")
         ("help,h", "view this help message")
         ("force-out,f", po::bool_switch(), "replace output file if exists")
-        ("no-clean,n", po::bool_switch(), "don't clean temp files on exit; use when running multiple instances")
+        ("input-list", po::value<std::string>(), "read input files from given file, one per line or NUL separated, in addition to or instead of INPUT-FILE arguments; OUTPUT-DIR is still required")
+        ("recursive,r", po::bool_switch(), "convert HTML files found in directories given as input, to the same subdirectories of OUTPUT-DIR")
+        ("incremental", po::bool_switch(), "skip documents, which output is newer than input and was converted with the same options")
+        ("resume", po::bool_switch(), "skip documents, which were converted with the same options according to journal, e.g. by a run which stopped")
+        ("journal", po::value<std::string>(), "journal of converted documents for --incremental and --resume; default is .dompdfui.journal in OUTPUT-DIR")
+        ("no-clean,n", po::bool_switch(), "don't clean temp files on exit; speeds up next launches")
         ("keep-php-scripts,k", po::bool_switch(), "don't remove generated php scripts in temp directory; ignore if --no-clean is not set")
+        ("no-zip-copy", po::bool_switch(), "don't write dompdf.zip to temp directory; the library is extracted directly from memory")
+        ("php-in-memory", po::bool_switch(), "run php-cli from memory instead of extracting it to temp directory (Linux only)")
+        ("opcache", po::bool_switch(), "cache compiled Dompdf sources in temp directory and preload them, instead of compiling them in each php-cli process")
+        ("cache-dir", po::value<std::string>(), "directory of output cache; documents converted earlier with the same content, assets and options are copied from it")
+        ("cache-size", po::value<unsigned long long>()->default_value(1024), "maximum size of output cache in megabytes; least recently used documents are evicted")
+        ("asset-cache", po::value<std::string>(), "directory of remote assets cache; with isRemoteEnabled images and style sheets are downloaded there concurrently before conversion")
+        ("asset-connections", po::value<unsigned>()->default_value(16), "maximum number of concurrent downloads of remote assets")
+        ("image-cache", po::value<std::string>(), "directory of optimized images; local and data URI images are downscaled to their size in document at --dpi and recompressed there before conversion")
+        ("image-quality", po::value<unsigned>()->default_value(85), "quality of optimized JPEG images, 1-100; other images are recompressed to lossless PNG")
+        ("split-size", po::value<unsigned long long>()->default_value(0), "split documents larger than given size (in bytes) to parts at page breaks and table rows, convert the parts in parallel and merge them; 0 disables splitting")
+        ("serve", po::value<std::string>(), "run as daemon with a pool of --jobs php-cli workers, accepting jobs on unix domain socket with given path")
+        ("client", po::value<std::string>(), "convert files by daemon listening on unix domain socket with given path; print daemon statistics if no files are given")
+        ("max-queue", po::value<unsigned>()->default_value(256), "maximum number of jobs waiting in daemon queue; further jobs are rejected until the queue shrinks")
+        ("max-request-size", po::value<unsigned long long>()->default_value(64ull << 20), "maximum size of HTML document (in bytes) accepted by daemon in one job; larger jobs are rejected")
+        ("stream-framing", po::value<std::string>()->default_value("none"), "how several documents are separated in standard input, when '-' is given as INPUT and OUTPUT: none, nul or length")
+        ("report", po::value<std::string>(), "append metrics of the run and of each document to given file as JSON lines")
+        ("prometheus", po::value<std::string>(), "write metrics of the run to given file in Prometheus text format")
+        ("register-fonts", po::value<std::string>(), "register fonts from given directory in --fontDir, and cache metrics of all fonts there, so that renders don't parse them")
         ;
 
-    po::options_description dopts("DomPdf Options");
-    dopts.add_options()
-        ("isPhpEnabled", po::value<bool>()->default_value(false))
-        ("isRemoteEnabled", po::value<bool>()->default_value(false))
-        ("isPdfAEnabled", po::value<bool>()->default_value(false))
-        ("isJavascriptEnabled", po::value<bool>()->default_value(true))
-        ("isHtml5ParserEnabled", po::value<bool>()->default_value(true))
-        ("isFontSubsettingEnabled", po::value<bool>()->default_value(true))
-        ("sslAllowSelfSigned", po::value<bool>()->default_value(true))
-        ("debugPng", po::value<bool>()->default_value(false))
-        ("debugKeepTemp", po::value<bool>()->default_value(false))
-        ("debugCss", po::value<bool>()->default_value(false))
-        ("debugLayout", po::value<bool>()->default_value(false))
-        ("debugLayoutLines", po::value<bool>()->default_value(true))
-        ("debugLayoutBlocks", po::value<bool>()->default_value(true))
-        ("debugLayoutInline", po::value<bool>()->default_value(true))
-        ("debugLayoutPaddingBox", po::value<bool>()->default_value(true))
-        ("dpi", po::value<std::string>()->default_value("96"))
-        ("fontHeightRatio", po::value<std::string>()->default_value("1.1"))
-        ("rootDir", po::value<std::string>())
-        ("tempDir", po::value<std::string>())
-        ("fontDir", po::value<std::string>())
-        ("fontCache", po::value<std::string>())
-        ("logOutputFile", po::value<std::string>())
-        ("defaultMediaType", po::value<std::string>()->default_value("screen"))
-        ("defaultPaperSize", po::value<std::string>()->default_value("a4"))
-        ("defaultPaperOrientation", po::value<std::string>()->default_value("portrait"))
-        ("defaultFont", po::value<std::string>()->default_value("dejavu serif"))
-        ("pdfBackend", po::value<std::string>()->default_value("CPDF"))
-        ("pdflibLicense", po::value<std::string>())
-        ("chroot", po::value<std::vector<std::string>>())
-        ("allowedRemoteHosts", po::value<std::vector<std::string>>())
-        ;
+    auto dopts = dompdf_options();
 
     po::options_description allopts("");
     allopts.add(hopts).add(popts).add(dopts);
@@ -145,12 +259,133 @@ std::tuple<int, std::vector<fs::path>, std::vector<fs::path>, po::variables_map>
         return {0, {}, {}, {}};
     }
 
-    if (!vm.count("iofiles") || vm["iofiles"].as<std::vector<std::string>>().size()<2) {
-        nw::cout << "Error: the options 'INPUT-FILE1' and 'OUTPUT-DIR' is required but missing\n";
+    if (vm.count("serve") && vm.count("client")) {
+        nw::cerr << "Error: the options 'serve' and 'client' can't be used together\n";
+        return {-1, {}, {}, {}};
+    }
+
+    if (vm.count("register-fonts") && (vm.count("serve") || vm.count("client"))) {
+        nw::cerr << "Error: the option 'register-fonts' can't be used with 'serve' or 'client'\n";
+        return {-1, {}, {}, {}};
+    }
+
+    // options, which a mode doesn't apply, are rejected instead of being ignored: daemon and conversion
+    // to standard output process documents by converter, which has no batch of files, and client leaves
+    // processing of documents to the daemon
+    const std::vector<std::string> batch_options {
+        "recursive", "incremental", "resume", "journal", "max-total-memory", "memory-state", "report", "prometheus" };
+    auto rejected = [&vm](const std::vector<std::string>& names, std::string_view mode){
+      for(const auto& name: names) {
+        if(!vm.count(name) || vm[name].defaulted()) continue;
+        nw::cerr << "Error: the option '" << name << "' can't be used with " << mode << '\n';
+        return true;
+      }
+      return false;
+    };
+    if (vm.count("serve")) {
+        auto names = batch_options;
+        names.insert(names.end(), { "input-list", "stream-framing" });
+        if (rejected(names, "'serve'")) return {-1, {}, {}, {}};
+        if (vm.count("iofiles")) {
+            nw::cerr << "Error: input files can't be given with 'serve'\n";
+            return {-1, {}, {}, {}};
+        }
+    }
+    if (vm.count("client")) {
+        auto names = batch_options;
+        names.insert(names.end(), { "cache-dir", "cache-size", "asset-cache", "asset-connections", "image-cache", "image-quality",
+                                    "split-size", "batch-size", "php-memory-limit", "max-queue", "max-request-size", "opcache",
+                                    "php-in-memory", "no-zip-copy", "stream-framing" });
+        if (rejected(names, "'client'")) return {-1, {}, {}, {}};
+    }
+
+    if (vm.count("asset-cache") && !vm["isRemoteEnabled"].as<bool>()) {
+        nw::cerr << "Error: the option 'asset-cache' requires 'isRemoteEnabled'\n";
+        return {-1, {}, {}, {}};
+    }
+
+    if (vm.count("register-fonts") && !vm.count("fontDir")) {
+        nw::cerr << "Error: the option 'fontDir' is required by 'register-fonts'\n";
+        return {-1, {}, {}, {}};
+    }
+
+    if (vm.count("serve") || vm.count("register-fonts") || (vm.count("client") && !vm.count("iofiles") && !vm.count("input-list"))) {
+        cleanup_on_exit = !vm.count("client") && !vm["no-clean"].as<bool>() ;
+        return {1, {}, {}, vm};
+    }
+
+    // input files from --input-list go before OUTPUT-DIR, as if they were given in arguments,
+    // so that long lists don't hit the limit of command line length; the list may be the only input
+    auto iofiles = vm.count("iofiles") ? vm["iofiles"].as<std::vector<std::string>>() : std::vector<std::string>{};
+    if (vm.count("input-list")) {
+        if (iofiles.empty()) {
+            nw::cerr << "Error: the option 'OUTPUT-DIR' is required by 'input-list' but missing\n";
+            return {-1, {}, {}, {}};
+        }
+        auto list_path = vm["input-list"].as<std::string>();
+        nw::ifstream is ( list_path, std::ios::binary );
+        if (!is.is_open()) {
+            nw::cerr << "Error: can't open file " << list_path << '\n';
+            return {-1, {}, {}, {}};
+        }
+        std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+        char separator = content.find('\0') != content.npos ? '\0' : '\n';
+        std::vector<std::string> list;
+        std::istringstream ls(content);
+        for(std::string line; std::getline(ls, line, separator); ) {
+            if (separator == '\n' && !line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) list.push_back(line);
+        }
+        if (list.empty() && iofiles.size()<2) {
+            nw::cerr << "Error: no input files in " << list_path << '\n';
+            return {-1, {}, {}, {}};
+        }
+        iofiles.insert(iofiles.end() - 1, list.begin(), list.end());
+    }
+
+    if (iofiles.size()<2) {
+        nw::cerr << "Error: the options 'INPUT-FILE1' and 'OUTPUT-DIR' is required but missing\n";
         return {-1, {}, {}, {}};
     }
 
-    for(const auto& e: vm["iofiles"].as<std::vector<std::string>>()) in_files.emplace_back(e);
+    auto framing = vm["stream-framing"].as<std::string>();
+    if (framing != "none" && framing != "nul" && framing != "length") {
+        nw::cerr << "Error: the option 'stream-framing' must be one of: none, nul, length\n";
+        return {-1, {}, {}, {}};
+    }
+
+    // '-' as OUTPUT means standard output, and as the only INPUT - standard input
+    bool stdin_input = std::count(iofiles.begin(), iofiles.end() - 1, "-");
+    if (stdin_input && (iofiles.size()>2 || iofiles.back()!="-")) {
+        nw::cerr << "Error: standard input can be converted only alone and to standard output\n";
+        return {-1, {}, {}, {}};
+    }
+    // client writes every result to a file in OUTPUT-DIR
+    if (vm.count("client") && (stdin_input || iofiles.back() == "-")) {
+        nw::cerr << "Error: standard input and output can't be used with 'client'\n";
+        return {-1, {}, {}, {}};
+    }
+    if (iofiles.back() == "-") {
+        stdout_is_output = true;
+        auto names = batch_options;
+        names.push_back("max-request-size");
+        if (rejected(names, "conversion to standard output")) return {-1, {}, {}, {}};
+        if (iofiles.size()>2 && framing == "none") {
+            nw::cerr << "Error: several input files can be converted to standard output only with --stream-framing\n";
+            return {-1, {}, {}, {}};
+        }
+        for(size_t i=0; i+1<iofiles.size(); ++i) {
+            in_files.emplace_back(stdin_input ? fs::path("-") : fs::absolute(iofiles[i]));
+            if(!stdin_input && !fs::exists(in_files.back())) {
+                nw::cerr << "Error: file '" << in_files.back().string() << "' not found\n";
+                return {-1, {}, {}, {}};
+            }
+        }
+        cleanup_on_exit = !vm["no-clean"].as<bool>() ;
+        return {1, in_files, {"-"}, vm};
+    }
+
+    for(const auto& e: iofiles) in_files.emplace_back(e);
     std::transform(in_files.begin(), in_files.end(), in_files.begin(), [](auto& e){
       return fs::absolute(e);
     });
@@ -159,129 +394,312 @@ std::tuple<int, std::vector<fs::path>, std::vector<fs::path>, po::variables_map>
     if(fs::is_regular_file(out_dir)) out_dir = out_dir.parent_path();
     if(!fs::exists(out_dir)) fs::create_directory(out_dir);
     if(!fs::is_directory(out_dir)) {
-        nw::cout << "Error: can't open output directory " << out_dir.string() << '\n' ;
+        nw::cerr << "Error: can't open output directory " << out_dir.string() << '\n' ;
         return {-1, {}, {}, {}};
     }
     std::erase_if(in_files, [](const auto& e){
       bool remove_element = !fs::exists(e);
-      if(remove_element) nw::cout << "Warning: file '" << e.string() << "' not found\n";
+      if(remove_element) nw::cerr << "Warning: file '" << e.string() << "' not found\n";
       return remove_element;
     });
     if(in_files.empty()) return {-1, {}, {}, {}};
 
-    std::transform(in_files.begin(), in_files.end(), std::back_inserter(out_files), [&out_dir](const auto& e){
-      return out_dir / e.filename().replace_extension("pdf");
-    });
+    // with --recursive directories are replaced by HTML files found in them
+    std::vector<fs::path> files;
+    for(const auto& e: in_files) {
+      if(!vm["recursive"].as<bool>() || !fs::is_directory(e)) {
+        files.push_back(e);
+        out_files.push_back(out_dir / e.filename().replace_extension("pdf"));
+        continue;
+      }
+      std::vector<fs::path> found;
+      for(const auto& f: fs::recursive_directory_iterator(e)) {
+        auto ext = f.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+        if(f.is_regular_file() && (ext == ".html" || ext == ".htm")) found.push_back(f.path());
+      }
+      std::sort(found.begin(), found.end());
+      for(const auto& f: found) {
+        files.push_back(f);
+        out_files.push_back((out_dir / f.lexically_relative(e)).replace_extension("pdf"));
+        fs::create_directories(out_files.back().parent_path());
+      }
+    }
+    in_files = std::move(files);
+    if(in_files.empty()) {
+        nw::cerr << "Error: no HTML files found\n";
+        return {-1, {}, {}, {}};
+    }
+
+    // existing outputs are checked by --incremental and --resume against the journal
+    if(vm["incremental"].as<bool>() || vm["resume"].as<bool>() || vm.count("journal")) {
+      journal_path = vm.count("journal") ? fs::absolute(vm["journal"].as<std::string>()) : out_dir / ".dompdfui.journal";
+    }
 
-    if(!vm["force-out"].as<bool>()){
+    if(!vm["force-out"].as<bool>() && !vm["incremental"].as<bool>() && !vm["resume"].as<bool>()){
       bool already_exists = std::any_of(out_files.begin(), out_files.end(), [](const auto& e){
         bool result = fs::exists(e);
-        if(result) nw::cout << "Warning: file '" << e.string() << "' already exists\n";
+        if(result) nw::cerr << "Warning: file '" << e.string() << "' already exists\n";
         return result;
       });
       if( already_exists ) return {-1, {}, {}, {}};
     }
 
-    cleanup_on_exit = !vm["no-clean"].as<bool>() ;
+    // temp directory belongs to daemon in client mode
+    cleanup_on_exit = !vm.count("client") && !vm["no-clean"].as<bool>() ;
   }
   catch(const po::error& e) {
-    nw::cout << "Error: " << e.what() << "\nTry:\t" << argv[0] << " --help\n";
+    nw::cerr << "Error: " << e.what() << "\nTry:\t" << argv[0] << " --help\n";
     return {-1, {}, {}, {}};
   }
   return {1, in_files, out_files, vm};
 }
 
 
-// function generate php script from Options and run it
-void html2pdf(const std::vector<fs::path>& in_files, const std::vector<fs::path>& out_files, const po::variables_map& opts)
+// function register fonts from directory in Dompdf font directory, and cache metrics of all known fonts;
+// font directory and cache are frozen afterwards, renders only read them
+void register_fonts(const po::variables_map& opts)
 {
-  auto now = std::chrono::system_clock::now();
-  auto now_c = std::chrono::system_clock::to_time_t(now);
-  auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-  std::tm *local_time = std::localtime(&now_c);
-  std::stringstream ss;
-  ss << std::put_time(local_time, "html2pdf_%d%B%Y_%Hh%Mm%Ss") << std::setfill('0')
-     << std::setw(3) << milliseconds.count() << "ms.php" ;
-  auto script_path = temp_path() / ss.str() ;
-  nw::ofstream script( script_path ) ;
-  if(!script.is_open()) throw std::runtime_error("Can't open file: " + script_path.string()) ;
-  auto php_array = [](const std::vector<std::string>& v){
-    std::string r;
-    if(v.empty()) return r;
-    if(std::all_of(v.begin(), v.end(), [](const auto& e){ return e.empty(); })) return r;
-    std::vector<std::string> vv;
-    using Separator = boost::char_separator<char>;
-    using Tokenizer = boost::tokenizer<Separator>;
-    Separator sep(";,");
-    for(const auto& e: v){
-      Tokenizer tokens(e, sep);
-      for (Tokenizer::iterator tok_iter = tokens.begin(); tok_iter != tokens.end(); ++tok_iter){
-        vv.push_back(*tok_iter);
-      }
-    }
-    r += '[';
-    std::for_each(vv.begin(), vv.end(), [&r](const auto& e){ r += '"' + e + "\","; });
-    r.pop_back();
-    r += ']';
-    return r;
+  auto fonts_dir = fs::absolute(opts["register-fonts"].as<std::string>());
+  if(!fs::is_directory(fonts_dir)) throw std::runtime_error("can't open directory " + fonts_dir.string());
+  auto options = library_options(opts);
+  fs::create_directories(*options.fontDir);
+  set_writable(*options.fontDir, true);
+  if(options.fontCache) set_writable(*options.fontCache, true);
+  std::vector<std::string> fonts;
+  for(const auto& e: fs::recursive_directory_iterator(fonts_dir)) {
+    auto ext = e.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+    if(e.is_regular_file() && (ext == ".ttf" || ext == ".otf")) fonts.push_back(e.path().string());
+  }
+  if(fonts.empty()) throw std::runtime_error("no fonts found in " + fonts_dir.string());
+  std::sort(fonts.begin(), fonts.end());
+
+  // script takes font files from argv; family, weight and style are read from the font itself
+  std::stringstream script;
+  script << php_options_script(options, false) <<
+    "$options->setChroot(array_merge($options->getChroot(), ['" << fonts_dir.string() << "']));\n\n"
+    "$dompdf = new Dompdf($options);\n"
+    "$fontMetrics = $dompdf->getFontMetrics();\n"
+    "$result = 0;\n"
+    "foreach (array_slice($argv, 1) as $file) {\n"
+    "  try {\n"
+    "    $font = \\FontLib\\Font::load($file);\n"
+    "    $font->parse();\n"
+    "    $family = $font->getFontName();\n"
+    "    $subfamily = strtolower($font->getFontSubfamily());\n"
+    "    $font->close();\n"
+    "    $style = [\n"
+    "      'family' => $family,\n"
+    "      'weight' => str_contains($subfamily, 'bold') ? 'bold' : 'normal',\n"
+    "      'style' => str_contains($subfamily, 'italic') || str_contains($subfamily, 'oblique') ? 'italic' : 'normal'\n"
+    "    ];\n"
+    "    if (!$fontMetrics->registerFont($style, $file)) throw new Exception('font is not registered');\n"
+    "    echo $file, ': ', $family, ' ', $style['weight'], ' ', $style['style'], PHP_EOL;\n"
+    "  } catch (Throwable $e) {\n"
+    "    echo 'Error: ', $file, ': ', $e->getMessage(), PHP_EOL;\n"
+    "    $result = -1;\n"
+    "  }\n"
+    "}\n"
+    << php_fonts_warmup_script() <<
+    "exit($result);\n" ;
+  auto script_path = write_php_script("fonts", script.str());
+  auto php_args = php_ini_args(options);
+  php_args.push_back(script_path.filename().string());
+  php_args.insert(php_args.end(), fonts.begin(), fonts.end());
+  auto r = run_process(php_exe_path, php_args, temp_path());
+  if( cleanup_on_exit || !opts["keep-php-scripts"].as<bool>() ) fs::remove(script_path);
+  set_writable(*options.fontDir, false);
+  if(options.fontCache) set_writable(*options.fontCache, false);
+  nw::cout << r.out << r.err;
+  if(!r.ok()) throw std::runtime_error("Can't register fonts: php-cli " + r.status_str());
+}
+
+
+// function return true, if php-cli process was stopped by exceeding its memory_limit
+bool out_of_memory(const process_result& r)
+{
+  return !r.ok() && (r.out.find("Allowed memory size of") != r.out.npos || r.err.find("Allowed memory size of") != r.err.npos);
+}
+
+
+// metrics of conversion of files, written by --report and --prometheus
+struct run_metrics {
+  struct document {
+    std::string status;         // "ok", "failed", "cached" or "skipped"
+    double render_time {-1};    // seconds spent by Dompdf on the document, if known
+    int process {-1};           // index of php-cli process in processes
+    long long peak_memory {-1}; // peak memory of the document in bytes, if known
   };
-  script <<
-    "<?php\n"
-    "if ($argc<3) exit(-1);\n\n"
-    "require_once 'dompdf/autoload.inc.php';\n\n"
-    "use Dompdf\\Dompdf;\n"
-    "use Dompdf\\Options;\n\n"
-    "$options = new Options();\n"
-    "$options->setIsPhpEnabled("                    << opts["isPhpEnabled"].as<bool>() << ");\n"
-    "$options->setIsRemoteEnabled("                 << opts["isRemoteEnabled"].as<bool>() << ");\n"
-    "$options->setIsPdfAEnabled("                   << opts["isPdfAEnabled"].as<bool>() << ");\n"
-    "$options->setIsJavascriptEnabled("             << opts["isJavascriptEnabled"].as<bool>() << ");\n"
-    "$options->setIsHtml5ParserEnabled("            << opts["isHtml5ParserEnabled"].as<bool>() << ");\n"
-    "$options->setIsFontSubsettingEnabled("         << opts["isFontSubsettingEnabled"].as<bool>() << ");\n"
-    "$options->setDebugPng("                        << opts["debugPng"].as<bool>() << ");\n"
-    "$options->setDebugKeepTemp("                   << opts["debugKeepTemp"].as<bool>() << ");\n"
-    "$options->setDebugCss("                        << opts["debugCss"].as<bool>() << ");\n"
-    "$options->setDebugLayout("                     << opts["debugLayout"].as<bool>() << ");\n"
-    "$options->setDebugLayoutLines("                << opts["debugLayoutLines"].as<bool>() << ");\n"
-    "$options->setDebugLayoutBlocks("               << opts["debugLayoutBlocks"].as<bool>() << ");\n"
-    "$options->setDebugLayoutInline("               << opts["debugLayoutInline"].as<bool>() << ");\n"
-    "$options->setDebugLayoutPaddingBox("           << opts["debugLayoutPaddingBox"].as<bool>() << ");\n"
-    "$options->setDpi("                             << opts["dpi"].as<std::string>() << ");\n"
-    "$options->setFontHeightRatio("                 << opts["fontHeightRatio"].as<std::string>() << ");\n" ;
-
-  if(opts.count("rootDir")) script <<
-    "$options->setRootDir('"                        << opts["rootDir"].as<std::string>() << "');\n" ;
-
-  if(opts.count("tempDir")) script <<
-    "$options->setTempDir('"                        << opts["tempDir"].as<std::string>() << "');\n" ;
-
-  if(opts.count("fontDir")) script <<
-    "$options->setFontDir('"                        << opts["fontDir"].as<std::string>() << "');\n" ;
-
-  if(opts.count("fontCache")) script <<
-    "$options->setFontCache('"                      << opts["fontCache"].as<std::string>() << "');\n" ;
-
-  if(opts.count("logOutputFile")) script <<
-    "$options->setLogOutputFile('"                  << opts["logOutputFile"].as<std::string>() << "');\n" ;
+  // metrics of php-cli process are shared by all documents of its batch
+  struct process {
+    process_result result;      // without captured output
+    size_t documents {};        // number of documents given to the process
+    unsigned long long memory_limit {}; // memory_limit of php-cli
+    double queue_wait {};       // seconds from start of conversion to start of the process
+  };
+  std::vector<document> documents;
+  std::vector<process> processes;
+  size_t memory_retries {};     // number of documents restarted with larger memory limit
+  double script_time {};        // seconds spent on generation of php script
+  double conversion_time {};    // seconds from start of the first php-cli process to exit of the last one
+};
 
-  script <<
-    "$options->setDefaultMediaType('"               << opts["defaultMediaType"].as<std::string>() << "');\n"
-    "$options->setDefaultPaperSize('"               << opts["defaultPaperSize"].as<std::string>() << "');\n"
-    "$options->setDefaultPaperOrientation('"        << opts["defaultPaperOrientation"].as<std::string>() << "');\n"
-    "$options->setDefaultFont('"                    << opts["defaultFont"].as<std::string>() << "');\n"
-    "$options->setPdfBackend('"                     << opts["pdfBackend"].as<std::string>() << "');\n" ;
 
-  if(opts.count("pdflibLicense")) script <<
-    "$options->setPdflibLicense('"                  << opts["pdflibLicense"].as<std::string>() << "');\n" ;
+// function return string as JSON string literal
+std::string json_str(std::string_view s)
+{
+  std::string r = "\"";
+  for(unsigned char c: s) {
+    if(c == '"' || c == '\\') {
+      r += '\\';
+      r += c;
+    } else if(c < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      r += buf;
+    } else {
+      r += c;
+    }
+  }
+  return r + '"';
+}
 
-  if(opts.count("chroot")) script <<
-    "$options->setChroot(" << php_array(opts["chroot"].as<std::vector<std::string>>()) << ");\n" ;
 
-  if(opts.count("allowedRemoteHosts")) script <<
-    "$options->setAllowedRemoteHosts(" << php_array(opts["allowedRemoteHosts"].as<std::vector<std::string>>()) <<
-    ");\n" ;
+// function write metrics of conversion as JSON lines appended to --report file, and as Prometheus textfile
+void write_reports(const run_metrics& m, const std::vector<fs::path>& in_files, const std::vector<fs::path>& out_files,
+                   const std::vector<std::string>& errors, const po::variables_map& opts)
+{
+  auto num = [](double v){
+    if(v < 0) return std::string("null");
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(6) << v;
+    return os.str();
+  };
+  auto file_size = [](const fs::path& path){
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    return ec ? std::string("null") : std::to_string(size);
+  };
+  std::map<std::string, size_t> count;
+  double render_sum {}, user_sum {}, sys_sum {};
+  long max_rss {};
+  for(const auto& d: m.documents) {
+    ++count[d.status];
+    if(d.render_time > 0) render_sum += d.render_time;
+  }
+  for(const auto& p: m.processes) {
+    user_sum += p.result.user_time;
+    sys_sum += p.result.sys_time;
+    max_rss = std::max(max_rss, p.result.max_rss);
+  }
 
-  script << "\n$dompdf = new Dompdf($options);\n" ;
+  if(opts.count("report")) {
+    auto path = opts["report"].as<std::string>();
+    nw::ofstream os ( path, std::ios::app );
+    if(!os.is_open()) throw std::runtime_error("Can't open file: " + path) ;
+    os << "{\"type\":\"run\",\"time\":" << std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()
+       << ",\"version\":" << json_str(git_tag_str) << ",\"dompdf\":" << json_str(DOMPDF_VERSION)
+       << ",\"php\":" << json_str(PHPCLI_VERSION) << ",\"documents\":" << m.documents.size()
+       << ",\"ok\":" << count["ok"] << ",\"failed\":" << count["failed"] << ",\"cached\":" << count["cached"] << ",\"skipped\":" << count["skipped"]
+       << ",\"processes\":" << m.processes.size() << ",\"jobs\":" << opts["jobs"].as<unsigned>()
+       << ",\"batch_size\":" << opts["batch-size"].as<unsigned>()
+       << ",\"php_memory_limit\":" << opts["php-memory-limit"].as<unsigned long long>()
+       << ",\"max_total_memory\":" << opts["max-total-memory"].as<unsigned long long>()
+       << ",\"memory_retries\":" << m.memory_retries
+       << ",\"extraction_s\":" << num(extraction_time) << ",\"script_s\":" << num(m.script_time)
+       << ",\"conversion_s\":" << num(m.conversion_time) << ",\"user_s\":" << num(user_sum)
+       << ",\"sys_s\":" << num(sys_sum) << ",\"max_rss_kb\":" << max_rss << "}\n";
+    for(size_t i=0; i<m.documents.size(); ++i) {
+      const auto& d = m.documents[i];
+      os << "{\"type\":\"document\",\"input\":" << json_str(in_files[i].string())
+         << ",\"output\":" << json_str(out_files[i].string()) << ",\"input_size\":" << file_size(in_files[i])
+         << ",\"output_size\":" << (d.status == "failed" ? "null" : file_size(out_files[i]))
+         << ",\"status\":" << json_str(d.status) << ",\"error\":" << (errors[i].empty() ? "null" : json_str(errors[i]))
+         << ",\"render_s\":" << num(d.render_time)
+         << ",\"peak_memory\":" << (d.peak_memory < 0 ? "null" : std::to_string(d.peak_memory));
+      if(d.process >= 0) {
+        const auto& p = m.processes[d.process];
+        os << ",\"process\":{\"id\":" << d.process << ",\"documents\":" << p.documents
+           << ",\"queue_wait_s\":" << num(p.queue_wait) << ",\"spawn_s\":" << num(p.result.spawn_time) << ",\"wall_s\":" << num(p.result.wall_time)
+           << ",\"user_s\":" << num(p.result.user_time) << ",\"sys_s\":" << num(p.result.sys_time)
+           << ",\"max_rss_kb\":" << p.result.max_rss << ",\"memory_limit\":" << p.memory_limit
+           << ",\"exit_code\":" << p.result.exit_code
+           << ",\"signal\":" << p.result.signal << '}';
+      }
+      os << "}\n";
+    }
+    os.close();
+    if(!os) throw std::runtime_error("Can't write to file: " + path) ;
+  }
+
+  // textfile is replaced atomically, as Prometheus node exporter expects
+  if(opts.count("prometheus")) {
+    fs::path path = opts["prometheus"].as<std::string>();
+    auto tmp_path = fs::path(path).concat(".tmp");
+    nw::ofstream os ( tmp_path );
+    if(!os.is_open()) throw std::runtime_error("Can't open file: " + tmp_path.string()) ;
+    os << "# HELP dompdfui_documents Number of documents converted by the last run, by status.\n"
+          "# TYPE dompdfui_documents gauge\n";
+    for(auto status: { "ok", "failed", "cached", "skipped" })
+      os << "dompdfui_documents{status=\"" << status << "\"} " << count[status] << '\n';
+    os << "# HELP dompdfui_phase_seconds Duration of phases of the last run.\n"
+          "# TYPE dompdfui_phase_seconds gauge\n"
+          "dompdfui_phase_seconds{phase=\"extraction\"} " << extraction_time << "\n"
+          "dompdfui_phase_seconds{phase=\"script\"} " << m.script_time << "\n"
+          "dompdfui_phase_seconds{phase=\"conversion\"} " << m.conversion_time << "\n"
+          "# HELP dompdfui_render_seconds Total render time of documents of the last run, measured by Dompdf script.\n"
+          "# TYPE dompdfui_render_seconds gauge\n"
+          "dompdfui_render_seconds " << render_sum << "\n"
+          "# HELP dompdfui_php_processes Number of php-cli processes started by the last run.\n"
+          "# TYPE dompdfui_php_processes gauge\n"
+          "dompdfui_php_processes " << m.processes.size() << "\n"
+          "# HELP dompdfui_php_cpu_seconds CPU time of php-cli processes of the last run.\n"
+          "# TYPE dompdfui_php_cpu_seconds gauge\n"
+          "dompdfui_php_cpu_seconds{mode=\"user\"} " << user_sum << "\n"
+          "dompdfui_php_cpu_seconds{mode=\"system\"} " << sys_sum << "\n"
+          "# HELP dompdfui_php_max_rss_bytes Peak resident set size of php-cli processes of the last run.\n"
+          "# TYPE dompdfui_php_max_rss_bytes gauge\n"
+          "dompdfui_php_max_rss_bytes " << max_rss * 1024ull << "\n"
+          "# HELP dompdfui_memory_retries Number of documents of the last run restarted with larger memory limit.\n"
+          "# TYPE dompdfui_memory_retries gauge\n"
+          "dompdfui_memory_retries " << m.memory_retries << "\n"
+          "# HELP dompdfui_last_run_timestamp_seconds Time when the last run finished.\n"
+          "# TYPE dompdfui_last_run_timestamp_seconds gauge\n"
+          "dompdfui_last_run_timestamp_seconds " << std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() << '\n';
+    os.close();
+    if(!os) throw std::runtime_error("Can't write to file: " + tmp_path.string()) ;
+    fs::rename(tmp_path, path);
+  }
+}
+
+
+// function generate php script from Options and run it
+void html2pdf(const std::vector<fs::path>& in_files, const std::vector<fs::path>& out_files, const po::variables_map& opts)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto options = library_options(opts);
+  std::stringstream script;
+  script << php_options_script(options) << "if ($argc<3) exit(-1);\n" ;
+
+  // script takes pairs of input/output files from argv, or from NUL separated manifest file:
+  //     php.exe html2pdf.php IN1 OUT1 [IN2 OUT2] [...]
+  //     php.exe html2pdf.php --manifest FILE
+  // in the second case result of each document is appended to FILE.status as "N ok SECONDS PEAK" or
+  // "N fail SECONDS PEAK MESSAGE" line, where SECONDS is render time of the document and PEAK is its peak memory;
+  // PHP before 8.2 can't reset peak memory, so the memory in use after render is given, if peak wasn't raised by the document
+  script <<
+    "\n$jobs = [];\n"
+    "$status = NULL;\n"
+    "if ($argv[1] === '--manifest') {\n"
+    "  $fields = explode(\"\\0\", file_get_contents($argv[2]));\n"
+    "  for ($i = 0; $i + 1 < count($fields); $i += 2) $jobs[] = [$fields[$i], $fields[$i + 1]];\n"
+    "  $status = fopen($argv[2] . '.status', 'w');\n"
+    "} else {\n"
+    "  for ($i = 1; $i + 1 < $argc; $i += 2) $jobs[] = [$argv[$i], $argv[$i + 1]];\n"
+    "}\n\n" ;
 
   if( opts["isRemoteEnabled"].as<bool>() && opts["sslAllowSelfSigned"].as<bool>() ) {
     script <<
@@ -291,103 +709,888 @@ void html2pdf(const std::vector<fs::path>& in_files, const std::vector<fs::path>
       "    'verify_peer_name' => FALSE,\n"
       "    'allow_self_signed'=> TRUE\n"
       "  ]\n"
-      "]);\n"
-      "$dompdf->setHttpContext($context);\n" ;
+      "]);\n\n" ;
   }
 
   script <<
-    "$html_content = file_get_contents(\"$argv[1]\");\n"
-    "$dompdf->loadHtml($html_content);\n"
-    "$dompdf->render();\n"
-    "$output = $dompdf->output();\n"
-    "if(file_put_contents(\"$argv[2]\", $output) === FALSE){\n"
-    "  echo \"Error: can't write to file: $argv[2]\" , PHP_EOL;\n"
-    "  exit(-1);\n"
-    "}\n" ;
-  script.close();
+    "$fontMetrics = NULL;\n"
+    "$result = 0;\n"
+    "foreach ($jobs as $n => [$in_file, $out_file]) {\n"
+    "  $dompdf = new Dompdf($options);\n"
+    "  if ($fontMetrics === NULL) {\n"
+    "    $fontMetrics = new WorkerFontMetrics($dompdf->getCanvas(), $options);\n"
+    "    $dompdf->setFontMetrics($fontMetrics);\n"
+    "  } else {\n"
+    "    $fontMetrics->setCanvas($dompdf->getCanvas());\n"
+    "    $dompdf->setFontMetrics($fontMetrics);\n"
+    "  }\n" ;
+
+  if( opts["isRemoteEnabled"].as<bool>() && opts["sslAllowSelfSigned"].as<bool>() ) script <<
+    "  $dompdf->setHttpContext($context);\n" ;
+
+  script <<
+    "  $error = NULL;\n"
+    "  if (function_exists('memory_reset_peak_usage')) memory_reset_peak_usage();\n"
+    "  $peak_before = memory_get_peak_usage(TRUE);\n"
+    "  $memory = memory_get_usage(TRUE);\n"
+    "  $start = hrtime(TRUE);\n"
+    "  try {\n"
+    "    $html_content = file_get_contents($in_file);\n"
+    "    if ($html_content === FALSE) throw new Exception(\"can't read file: $in_file\");\n"
+    "    $dompdf->loadHtml($html_content);\n"
+    "    $dompdf->render();\n"
+    "    $output = $dompdf->output();\n"
+    "    $memory = memory_get_usage(TRUE);\n"
+    "    if (file_put_contents($out_file, $output) === FALSE) throw new Exception(\"can't write to file: $out_file\");\n"
+    "  } catch (Throwable $e) {\n"
+    "    $error = $e->getMessage();\n"
+    "    echo \"Error: \", $error, PHP_EOL;\n"
+    "    $result = -1;\n"
+    "  }\n"
+    "  if ($status) {\n"
+    "    $peak = memory_get_peak_usage(TRUE);\n"
+    "    $seconds = sprintf(' %.6f %d', (hrtime(TRUE) - $start) / 1e9, $peak > $peak_before || $n === 0 ? $peak : $memory);\n"
+    "    fwrite($status, $n . ($error === NULL ? ' ok' . $seconds : ' fail' . $seconds . ' ' . strtr($error, \"\\r\\n\", '  ')) . \"\\n\");\n"
+    "    fflush($status);\n"
+    "  }\n"
+    "  unset($dompdf, $html_content, $output);\n"
+    "}\n"
+    "exit($result);\n" ;
+  run_metrics metrics;
+  metrics.documents.resize(in_files.size());
+  metrics.script_time = seconds_since(start);
+
+  // documents converted before according to journal are skipped, documents found in output cache are copied,
+  // only the rest are converted
+  std::vector<size_t> queue(in_files.size());
+  std::iota(queue.begin(), queue.end(), 0);
+  std::unique_ptr<batch_journal> journal;
+  size_t skipped {};
+  if(!journal_path.empty()) {
+    journal = std::make_unique<batch_journal>(journal_path, options_digest(options));
+    bool incremental = opts["incremental"].as<bool>(), resume = opts["resume"].as<bool>();
+    std::erase_if(queue, [&](auto i){
+      std::error_code ec1, ec2;
+      auto out_time = fs::last_write_time(out_files[i], ec1);
+      if(ec1 || !journal->done(in_files[i], out_files[i])) return false;
+      bool skip = resume || (incremental && out_time > fs::last_write_time(in_files[i], ec2) && !ec2);
+      if(skip) {
+        metrics.documents[i].status = "skipped";
+        ++skipped;
+      }
+      return skip;
+    });
+  }
+
+  // with --asset-cache remote assets are downloaded beforehand, and php-cli converts copies of documents,
+  // which reference local copies of assets
+  auto php_inputs = in_files;
+  auto rewrite_dir = temp_path() / ("documents_" + std::to_string(std::random_device()()));
+  // function replace documents of queue by their rewritten copies, which are written to rewrite_dir
+  auto rewrite = [&](const std::vector<std::string>& rewritten, std::string_view suffix){
+    for(size_t n=0; n<queue.size(); ++n) {
+      if(rewritten[n].empty()) continue;
+      auto i = queue[n];
+      auto path = rewrite_dir / (std::to_string(i) + std::string(suffix) + in_files[i].filename().string());
+      write_file_atomic(path, rewritten[n]);
+      php_inputs[i] = path;
+    }
+  };
+  // function return contents of documents of queue; unreadable ones are empty
+  auto queue_contents = [&](){
+    std::vector<std::string> docs;
+    for(auto i: queue) {
+      try {
+        docs.push_back(read_file(php_inputs[i]));
+      }
+      catch(const std::exception&) {
+        // unreadable file is left for php-cli, to report the error
+        docs.emplace_back();
+      }
+    }
+    return docs;
+  };
+  if(options.asset_cache && !queue.empty()) {
+    asset_prefetcher prefetcher(fs::absolute(*options.asset_cache), options);
+    rewrite(prefetcher.prefetch(queue_contents()), "_");
+    nw::cout << "Asset cache: " << prefetcher.downloaded << " downloaded, " << prefetcher.revalidated << " revalidated, "
+             << prefetcher.fresh << " fresh, " << prefetcher.failed << " failed\n";
+  }
+
+  // with --image-cache images are optimized beforehand in the same way
+  if(options.image_cache && !queue.empty()) {
+    image_optimizer optimizer(fs::absolute(*options.image_cache), options);
+    rewrite(optimizer.optimize(queue_contents(), options.jobs), "_images_");
+    nw::cout << "Image cache: " << optimizer.optimized << " optimized (" << (optimizer.bytes_before >> 10) << " KiB to "
+             << (optimizer.bytes_after >> 10) << " KiB), " << optimizer.cached << " cached, " << optimizer.kept << " kept\n";
+  }
+
+  std::unique_ptr<output_cache> cache;
+  std::vector<std::string> cache_keys(in_files.size());
+  if(options.cache_dir) {
+    cache = std::make_unique<output_cache>(fs::absolute(*options.cache_dir), options.cache_size << 20);
+    std::vector<char> cached(in_files.size());
+    std::atomic<size_t> next_file {};
+    auto worker = [&](){
+      for(size_t n = next_file++; n < queue.size(); n = next_file++) {
+        auto i = queue[n];
+        try {
+          cache_keys[i] = cache->key(read_file(php_inputs[i]), php_inputs[i].parent_path(), options);
+        }
+        catch(const std::exception&) {
+          // unreadable file is left for php-cli, to report the error
+        }
+        cached[i] = cache->fetch_file(cache_keys[i], out_files[i]);
+        if(cached[i] && journal) journal->record(in_files[i], out_files[i]);
+      }
+    };
+    if(!queue.empty()) {
+      std::vector<std::jthread> workers;
+      for(size_t i=0; i<std::clamp<size_t>(opts["jobs"].as<unsigned>(), 1, queue.size()); ++i) workers.emplace_back(worker);
+    }
+    std::erase_if(queue, [&cached](auto i){ return cached[i]; });
+    for(size_t i=0; i<in_files.size(); ++i) if(cached[i]) metrics.documents[i].status = "cached";
+  }
+  std::vector<std::string> errors(in_files.size());
+  auto finish = [&](){
+    for(size_t i=0; i<in_files.size(); ++i) {
+      auto& status = metrics.documents[i].status;
+      if(status.empty()) status = errors[i].empty() ? "ok" : "failed";
+    }
+    if(cache) {
+      for(auto i: queue) if(errors[i].empty()) cache->store_file(cache_keys[i], out_files[i]);
+      auto evicted = cache->evict();
+      nw::cout << "Output cache: " << cache->hits << " hits, " << cache->misses << " misses, "
+               << evicted << " evicted\n";
+    }
+    if(journal) {
+      journal->compact();
+      if(skipped) nw::cout << "Skipped " << skipped << " documents converted before\n";
+    }
+    write_reports(metrics, in_files, out_files, errors, opts);
+  };
+  if(queue.empty()) {
+    fs::remove_all(rewrite_dir);
+    finish();
+    return;
+  }
+
+  auto script_start = std::chrono::steady_clock::now();
+  auto script_path = write_php_script("html2pdf", script.str());
+  metrics.script_time += seconds_since(script_start);
+
+  // with --split-size documents larger than it are split to parts, which are converted as separate tasks, and
+  // merged into the output file when the last of them is converted; tasks from in_files.size() on are the parts
+  struct document_part {
+    size_t doc;     // index of document
+    size_t index;   // index of part in the document
+  };
+  std::vector<document_part> parts;
+  std::vector<std::vector<size_t>> doc_parts(in_files.size());
+  auto php_outputs = out_files;
+  auto tasks = queue;
+  if(auto split_size = options.split_size) {
+    tasks.clear();
+    size_t split_count {};
+    for(auto i: queue) {
+      std::error_code ec;
+      std::vector<std::string> texts;
+      if(fs::file_size(php_inputs[i], ec) > split_size && !ec) {
+        nw::ifstream is ( php_inputs[i], std::ios::binary );
+        std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+        texts = split_html(content, split_size);
+      }
+      if(texts.empty()) {
+        tasks.push_back(i);
+        continue;
+      }
+      ++split_count;
+      for(size_t k=0; k<texts.size(); ++k) {
+        auto path = rewrite_dir / (std::to_string(i) + "_part" + std::to_string(k) + "_" + php_inputs[i].filename().string());
+        write_file_atomic(path, texts[k]);
+        doc_parts[i].push_back(php_inputs.size());
+        tasks.push_back(php_inputs.size());
+        parts.push_back({i, k});
+        php_inputs.push_back(path);
+        php_outputs.push_back(fs::path(path).replace_extension(".pdf"));
+      }
+    }
+    if(split_count) nw::cout << "Split " << split_count << " documents to " << parts.size() << " parts\n";
+  }
+  errors.resize(php_inputs.size());
+  metrics.documents.resize(php_inputs.size());
+  // function return path of document, or of its part, in memory model
+  auto model_path = [&](size_t i){
+    if(i < in_files.size()) return in_files[i];
+    const auto& part = parts[i - in_files.size()];
+    return fs::path(in_files[part.doc]).concat("#" + std::to_string(part.index));
+  };
   nw::cout.flush();
 
-  for(size_t i=0; i<in_files.size(); ++i) {
-    std::string ifile = in_files[i].string();
-    std::string ofile = out_files[i].string();
-    std::string memlimit = std::to_string( opts["php-memory-limit"].as<unsigned long long>() );
-    std::string cmd = "php.exe -d memory_limit=" + memlimit + " \"" + script_path.filename().string()
-                      + "\" \"" + ifile + "\" \"" + ofile + "\"" ;
-#if BOOST_OS_WINDOWS
-    cmd = temp_path().root_name().string() + " && cd \"" + temp_path().string() + "\" && " + cmd ;
-#else
-    cmd = "cd \"" + temp_path().string() + "\" && ./" + cmd ;
-#endif
-    if( nw::system(cmd.c_str()) )
-      throw std::runtime_error("Can't execute '" + script_path.filename().string() + "' with files:\n\t"
-                                + ifile + "\n\t" + ofile + '\n');
+  // largest files go first, so that one huge file doesn't hold up the end of the batch
+  std::vector<uintmax_t> sizes(php_inputs.size());
+  std::transform(php_inputs.begin(), php_inputs.end(), sizes.begin(), [](const auto& e){
+    std::error_code ec;
+    auto sz = fs::file_size(e, ec);
+    return ec ? 0 : sz;
+  });
+
+  // each document gets a memory limit: with --max-total-memory it is estimated by memory model,
+  // otherwise it is --php-memory-limit; documents running out of memory are retried alone with doubled limit
+  auto default_limit = opts["php-memory-limit"].as<unsigned long long>();
+  auto max_total_memory = opts["max-total-memory"].as<unsigned long long>();
+  auto max_limit = max_total_memory ? max_total_memory : default_limit * 8;
+  std::vector<unsigned long long> limits(php_inputs.size(), default_limit);
+  std::unique_ptr<memory_model> model;
+  if(max_total_memory) {
+    auto state_path = opts.count("memory-state") ? fs::path(opts["memory-state"].as<std::string>())
+                                                 : fs::temp_directory_path() / "dompdfui_memory.state";
+    model = std::make_unique<memory_model>(fs::absolute(state_path), default_limit, max_total_memory);
+    for(auto i: tasks) limits[i] = model->limit(model_path(i), sizes[i]);
+  }
+  std::stable_sort(tasks.begin(), tasks.end(), [&](auto i1, auto i2){
+    return std::tie(limits[i1], sizes[i1]) > std::tie(limits[i2], sizes[i2]);
+  });
+
+  // split queue to batches, each batch is converted by one php-cli process with the largest limit of its documents;
+  // files are dealt round-robin, so that batches have roughly equal total size; with estimated limits neighbours
+  // are batched together instead, so that small documents don't hold memory reserved for large ones
+  struct php_batch {
+    std::vector<size_t> docs;
+    unsigned long long memory_limit {};
+  };
+  size_t batch_size = std::max(1u, opts["batch-size"].as<unsigned>());
+  auto jobs = std::clamp<size_t>(opts["jobs"].as<unsigned>(), 1, tasks.size());
+  size_t batches_count = std::min(std::max((tasks.size() + batch_size - 1) / batch_size, jobs), tasks.size());
+  std::deque<php_batch> pending(batches_count);
+  for(size_t n=0; n<tasks.size(); ++n) {
+    auto& batch = pending[model ? n * batches_count / tasks.size() : n % batches_count];
+    batch.docs.push_back(tasks[n]);
+    batch.memory_limit = std::max(batch.memory_limit, limits[tasks[n]]);
+  }
+
+  auto ini_args = php_ini_args(options);
+  auto conversion_start = std::chrono::steady_clock::now();
+  std::mutex metrics_mutex;
+  // function run php-cli for given documents, and record its metrics
+  auto run_php = [&](const std::vector<std::string>& args, const std::vector<size_t>& docs, unsigned long long memory_limit,
+                     const font_install_dir& fonts){
+    auto php_args = ini_args;
+    auto font_args = fonts.php_args();
+    php_args.insert(php_args.end(), font_args.begin(), font_args.end());
+    // the last memory_limit directive overrides --php-memory-limit
+    php_args.insert(php_args.end(), { "-d", "memory_limit=" + std::to_string(memory_limit), script_path.filename().string() });
+    php_args.insert(php_args.end(), args.begin(), args.end());
+    auto queue_wait = seconds_since(conversion_start);
+    auto r = run_process(php_exe_path, php_args, temp_path());
+    std::lock_guard lk(metrics_mutex);
+    for(auto i: docs) metrics.documents[i].process = metrics.processes.size();
+    metrics.processes.push_back({r, docs.size(), memory_limit, queue_wait});
+    metrics.processes.back().result.out.clear();
+    metrics.processes.back().result.err.clear();
+    return r;
+  };
+  // error message of php-cli process, with its captured output
+  auto process_error = [](const process_result& r){
+    std::string msg = "php-cli " + r.status_str();
+    for(const auto& e: {r.out, r.err}) {
+      if(e.find_first_not_of(" \t\r\n") != e.npos) msg += "\n\t\t" + e.substr(0, e.find_last_not_of(" \t\r\n") + 1);
+    }
+    return msg;
+  };
+
+  // batch is started while memory limits of running batches fit --max-total-memory;
+  // one batch is always let to run, so that the conversion progresses
+  std::mutex pending_mutex;
+  std::condition_variable pending_cv;
+  size_t running {};
+  unsigned long long reserved {};
+  std::vector<unsigned long long> exceeded_limits(php_inputs.size());
+  // function record peak memory of converted document; it is at least the limit the document has exceeded before
+  auto record_peak = [&](size_t i, long long peak){
+    if(peak < 0) return;
+    metrics.documents[i].peak_memory = peak;
+    if(model) model->record(model_path(i), sizes[i], std::max<unsigned long long>(peak, exceeded_limits[i] + 1));
+  };
+  // function queue document alone with doubled memory limit, if php-cli ran out of memory and the limit may grow
+  auto retry = [&](size_t i, const process_result& r, unsigned long long memory_limit){
+    if(!out_of_memory(r) || memory_limit >= max_limit) return false;
+    exceeded_limits[i] = memory_limit;
+    if(model) model->record(model_path(i), sizes[i], memory_limit + 1);
+    std::lock_guard lk(pending_mutex);
+    pending.push_front({{i}, std::min(memory_limit * 2, max_limit)});
+    ++metrics.memory_retries;
+    return true;
+  };
+  // function record converted document in journal; parts of document are merged into its output file first,
+  // when the last of them is converted
+  std::mutex parts_mutex;
+  std::vector<size_t> remaining_parts(in_files.size());
+  for(size_t i=0; i<in_files.size(); ++i) remaining_parts[i] = doc_parts[i].size();
+  auto finished = [&](size_t i){
+    if(i >= in_files.size()) {
+      i = parts[i - in_files.size()].doc;
+      {
+        std::lock_guard lk(parts_mutex);
+        if(--remaining_parts[i]) return;
+      }
+      for(auto p: doc_parts[i]) {
+        if(errors[p].empty() || !errors[i].empty()) continue;
+        errors[i] = "part " + std::to_string(parts[p - in_files.size()].index + 1) + " of " + std::to_string(doc_parts[i].size()) + ": " + errors[p];
+      }
+      if(!errors[i].empty()) return;
+      try {
+        pdf_merger merger;
+        for(auto p: doc_parts[i]) {
+          nw::ifstream is ( php_outputs[p], std::ios::binary );
+          if(!is.is_open()) throw std::runtime_error("Can't open file: " + php_outputs[p].string()) ;
+          merger.append(std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()));
+        }
+        nw::ofstream os ( out_files[i], std::ios::binary );
+        os << merger.str();
+        os.close();
+        if(!os) throw std::runtime_error("Can't write to file: " + out_files[i].string()) ;
+      }
+      catch(const std::exception& e) {
+        errors[i] = std::string("can't merge parts: ") + e.what();
+        return;
+      }
+    }
+    if(errors[i].empty() && journal) journal->record(in_files[i], out_files[i]);
+  };
+
+  bool keep_scripts = !cleanup_on_exit && opts["keep-php-scripts"].as<bool>();
+  std::atomic<size_t> next_manifest {};
+  auto convert = [&](php_batch& job, const font_install_dir& fonts){
+    auto& batch = job.docs;
+    // single document is passed in arguments, unless its peak memory is needed by memory model
+    if(batch.size()==1 && !model) {
+      size_t i = batch.front();
+      try {
+        auto r = run_php({php_inputs[i].string(), php_outputs[i].string()}, batch, job.memory_limit, fonts);
+        if(!r.ok() && retry(i, r, job.memory_limit)) return;
+        if(!r.ok()) errors[i] = process_error(r);
+      }
+      catch(const std::exception& e) {
+        errors[i] = e.what();
+      }
+      finished(i);
+      return;
+    }
+    auto manifest_path = script_path;
+    manifest_path.replace_extension().concat("_" + std::to_string(next_manifest++) + ".lst");
+    auto status_path = manifest_path;
+    status_path.concat(".status");
+    // if php-cli crashes in the middle of batch (e.g. fatal error), the document being converted
+    // is marked as failed, or retried if it ran out of memory, and the rest of the batch is restarted in a new process
+    while(!batch.empty()) {
+      process_result r;
+      try {
+        nw::ofstream manifest( manifest_path, std::ios::binary );
+        if(!manifest.is_open()) throw std::runtime_error("Can't open file: " + manifest_path.string()) ;
+        for(auto i: batch) manifest << php_inputs[i].string() << '\0' << php_outputs[i].string() << '\0';
+        manifest.close();
+        fs::remove(status_path);
+        r = run_php({"--manifest", manifest_path.string()}, batch, job.memory_limit, fonts);
+      }
+      catch(const std::exception& e) {
+        for(auto i: batch) {
+          errors[i] = e.what();
+          finished(i);
+        }
+        break;
+      }
+      std::vector<char> done(batch.size());
+      nw::ifstream status( status_path );
+      for(std::string line; std::getline(status, line); ) {
+        std::istringstream is(line);
+        size_t k;
+        std::string result;
+        if(!(is >> k >> result) || k >= batch.size()) continue;
+        done[k] = true;
+        double seconds;
+        long long peak;
+        if(is >> seconds) metrics.documents[batch[k]].render_time = seconds;
+        if(result == "ok" && is >> peak) record_peak(batch[k], peak);
+        if(result != "ok") {
+          std::getline(is >> peak >> std::ws, errors[batch[k]]);
+          if(errors[batch[k]].empty()) errors[batch[k]] = "unknown error";
+        }
+        finished(batch[k]);
+      }
+      status.close();
+      auto first_undone = std::find(done.begin(), done.end(), false);
+      if(first_undone == done.end()) break;
+      auto pos = std::distance(done.begin(), first_undone);
+      if(!retry(batch[pos], r, job.memory_limit)) {
+        errors[batch[pos]] = process_error(r);
+        finished(batch[pos]);
+      }
+      std::vector<size_t> rest;
+      for(size_t j=pos+1; j<batch.size(); ++j) if(!done[j]) rest.push_back(batch[j]);
+      batch = std::move(rest);
+    }
+    if(!keep_scripts) {
+      fs::remove(manifest_path);
+      fs::remove(status_path);
+    }
+  };
+  // each worker thread installs fonts of @font-face rules in a directory of its own, kept by its php-cli processes
+  auto worker = [&](){
+    font_install_dir fonts;
+    for(;;) {
+      php_batch job;
+      {
+        std::unique_lock lk(pending_mutex);
+        pending_cv.wait(lk, [&](){
+          if(pending.empty()) return !running;
+          return !running || !max_total_memory || reserved + pending.front().memory_limit <= max_total_memory;
+        });
+        if(pending.empty()) return;
+        job = std::move(pending.front());
+        pending.pop_front();
+        ++running;
+        reserved += job.memory_limit;
+      }
+      auto memory_limit = job.memory_limit;
+      convert(job, fonts);
+      {
+        std::lock_guard lk(pending_mutex);
+        --running;
+        reserved -= memory_limit;
+      }
+      pending_cv.notify_all();
+    }
+  };
+  {
+    std::vector<std::jthread> workers;
+    for(size_t i=0; i<jobs; ++i) workers.emplace_back(worker);
   }
 
-  if( !cleanup_on_exit && !opts["keep-php-scripts"].as<bool>()  ) fs::remove(script_path);
+  metrics.conversion_time = seconds_since(conversion_start);
+  if(model) model->save();
+  // metrics of parts are added up to their documents
+  for(size_t n=0; n<parts.size(); ++n) {
+    auto& d = metrics.documents[parts[n].doc];
+    const auto& p = metrics.documents[in_files.size() + n];
+    if(p.render_time >= 0) d.render_time = std::max(d.render_time, 0.0) + p.render_time;
+    if(d.process < 0) d.process = p.process;
+    d.peak_memory = std::max(d.peak_memory, p.peak_memory);
+  }
+  metrics.documents.resize(in_files.size());
+  errors.resize(in_files.size());
+
+  if(!keep_scripts) {
+    fs::remove(script_path);
+    fs::remove_all(rewrite_dir);
+  }
+  finish();
+
+  auto failed_count = std::count_if(errors.begin(), errors.end(), [](const auto& e){ return !e.empty(); });
+  if( failed_count ) {
+    std::string msg = "Can't execute '" + script_path.filename().string() + "' with files:\n" ;
+    for(size_t i=0; i<in_files.size(); ++i) {
+      if(!errors[i].empty()) msg += "\t" + in_files[i].string() + "\n\t" + out_files[i].string() + "\n\t\t" + errors[i] + '\n';
+    }
+    msg += std::to_string(failed_count) + " of " + std::to_string(in_files.size()) + " files failed to convert";
+    throw std::runtime_error(msg);
+  }
 }
 
 
-// function return application specific temp path
-fs::path temp_path()
+// function return value of option as string, in form that is accepted by Dompdf\Options::set()
+std::string option_value_str(const po::variable_value& v)
 {
-  std::string dir_name = "dompdfui_" + std::string(git_hash_str);
-  return fs::temp_directory_path() / dir_name ;
+  if(auto p = boost::any_cast<bool>(&v.value())) return *p ? "1" : "0";
+  if(auto p = boost::any_cast<std::string>(&v.value())) return *p;
+  if(auto p = boost::any_cast<std::vector<std::string>>(&v.value())) {
+    std::string r;
+    for(const auto& e: *p) r += (r.empty() ? "" : ",") + e;
+    return r;
+  }
+  return {};
 }
 
 
-// function extract embedded resources
-void extract_embedded_resources(const po::variables_map& opts)
+#if BOOST_OS_UNIX
+
+// Daemon protocol, each request and reply starts with a text line, which may be followed by binary data:
+//     client: "RENDER <options_len> <html_len>\n" <options> <html>
+//             options are "name=value\n" lines, overriding Dompdf options of the daemon for this job
+//     daemon: "OK <pdf_len>\n" <pdf>  |  "ERROR <message_len>\n" <message>  |  "BUSY <queue_depth>\n"
+//     client: "STATS\n"
+//     daemon: "STATS queue=<n> busy=<n> workers=<n> done=<n> failed=<n> rejected=<n> restarts=<n> cached=<n>\n"
+
+
+// function run daemon: converter with pool of php-cli workers, which converts jobs received through unix domain socket
+void serve(const po::variables_map& opts)
 {
-  auto php_rsc_p = embedded::resource<"php.exe">().data();
-  auto php_rsc_sz = embedded::resource<"php.exe">().size();
-  auto dompdf_rsc_p = embedded::resource<"dompdf.zip">().data();
-  auto dompdf_rsc_sz = embedded::resource<"dompdf.zip">().size();
-  auto extract = [](const char* p, size_t sz, const fs::path& path){
-    nw::ofstream os ( path, std::ios::binary );
-    if(!os.is_open()) throw std::runtime_error("Can't open file: " + path.string()) ;
-    os.exceptions(std::ios_base::badbit);
-    try { os.write(p, sz); }
-    catch(std::exception&) { throw std::runtime_error("Can't write to file: " + path.string()) ; }
-    os.close();
+  auto options = library_options(opts);
+  auto max_request_size = opts["max-request-size"].as<unsigned long long>();
+  fs::path socket_path = opts["serve"].as<std::string>();
+
+  // SIGINT and SIGTERM are blocked before any thread starts, so that every thread inherits the mask,
+  // and they are taken by sigwait() of the signal thread only
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listen_fd < 0) throw std::runtime_error("Can't create socket: " + std::string(strerror(errno)));
+  sockaddr_un addr {};
+  addr.sun_family = AF_UNIX;
+  if(socket_path.string().size() >= sizeof(addr.sun_path)) {
+    close(listen_fd);
+    throw std::runtime_error("Socket path is too long: " + socket_path.string());
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+  if(fs::is_socket(socket_path)) fs::remove(socket_path);
+  if(bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || listen(listen_fd, 128)) {
+    close(listen_fd);
+    throw std::runtime_error("Can't listen on socket " + socket_path.string() + ": " + strerror(errno));
+  }
+
+  converter conv(options);
+  std::mutex m;
+  unsigned rejected {};
+  std::set<int> client_fds;     // connections being served; they are shut down, when the daemon stops
+  std::atomic<bool> stopping {};
+
+  auto handle_client = [&](int fd){
+    std::string line;
+    while(read_line(fd, line)) {
+      if(line == "STATS") {
+        auto s = conv.stats();
+        unsigned rejected_count {};
+        {
+          std::lock_guard lk(m);
+          rejected_count = rejected;
+        }
+        std::string stats = "STATS queue=" + std::to_string(s.queue)
+                          + " busy=" + std::to_string(s.busy)
+                          + " workers=" + std::to_string(s.workers)
+                          + " done=" + std::to_string(s.done)
+                          + " failed=" + std::to_string(s.failed)
+                          + " rejected=" + std::to_string(rejected_count)
+                          + " restarts=" + std::to_string(s.restarts)
+                          + " cached=" + std::to_string(s.cached) + '\n';
+        if(!write_all(fd, stats)) break;
+        continue;
+      }
+      std::istringstream is(line);
+      std::string cmd;
+      size_t options_len {}, html_len {};
+      if(!(is >> cmd >> options_len >> html_len) || cmd != "RENDER" || options_len > 65536 || html_len > max_request_size) {
+        std::string msg = html_len > max_request_size ? "document is larger than --max-request-size of daemon" : "bad request";
+        write_all(fd, "ERROR " + std::to_string(msg.size()) + '\n' + msg);
+        break;
+      }
+      std::string overrides(options_len, '\0'), html(html_len, '\0');
+      if(!read_exact(fd, overrides.data(), options_len) || !read_exact(fd, html.data(), html_len)) break;
+      std::string error;
+      auto job_options = options;
+      std::istringstream os(overrides);
+      for(std::string o; std::getline(os, o); ) {
+        try {
+          if(o.find('=') == o.npos) throw std::runtime_error("unknown option: " + o);
+          set_option(job_options, o.substr(0, o.find('=')), o.substr(o.find('=') + 1));
+        }
+        catch(const std::exception& e) {
+          error = e.what();
+        }
+      }
+      if(!error.empty()) {
+        if(!write_all(fd, "ERROR " + std::to_string(error.size()) + '\n' + error)) break;
+        continue;
+      }
+      std::future<std::vector<std::byte>> result;
+      try {
+        result = conv.convert(html, job_options);
+      }
+      catch(const queue_full&) {
+        {
+          std::lock_guard lk(m);
+          ++rejected;
+        }
+        if(!write_all(fd, "BUSY " + std::to_string(conv.stats().queue) + '\n')) break;
+        continue;
+      }
+      std::string reply;
+      try {
+        auto pdf = result.get();
+        reply = "OK " + std::to_string(pdf.size()) + '\n';
+        reply.append(reinterpret_cast<const char*>(pdf.data()), pdf.size());
+      }
+      catch(const std::exception& e) {
+        reply = "ERROR " + std::to_string(std::strlen(e.what())) + '\n' + e.what();
+      }
+      if(!write_all(fd, reply)) break;
+    }
+    std::lock_guard lk(m);
+    client_fds.erase(fd);
+    close(fd);
   };
-  auto php_exe_target_path = temp_path() ;
-  if(!fs::exists(php_exe_target_path)) fs::create_directory(php_exe_target_path);
-  php_exe_target_path /= "php.exe" ;
-  if(!fs::exists(php_exe_target_path)) {
-    extract(php_rsc_p, php_rsc_sz, php_exe_target_path) ;
-#if BOOST_OS_UNIX
-    fs::permissions(php_exe_target_path, fs::perms::owner_all | fs::perms::group_all, fs::perm_options::add);
-#endif
+
+  // signal thread wakes accept() by shutting down the listening socket
+  std::jthread signal_thread([&](std::stop_token st){
+    int sig {};
+    while(sigwait(&stop_signals, &sig) == 0) {
+      if(st.stop_requested() || sig == SIGINT || sig == SIGTERM) break;
+    }
+    stopping = true;
+    shutdown(listen_fd, SHUT_RDWR);
+  });
+
+  nw::cout << "Listening on " << socket_path.string() << " with " << options.jobs << " workers" << std::endl;
+
+  // client threads are joined before the converter is destroyed; finished ones are joined as new clients come
+  struct client_thread {
+    std::atomic<bool> done {};
+    std::jthread thread;
+  };
+  std::list<client_thread> clients;
+  while(!stopping) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if(fd < 0) {
+      if(!stopping && (errno == EINTR || errno == ECONNABORTED)) continue;
+      break;
+    }
+    clients.remove_if([](const client_thread& c){ return c.done.load(); });
+    {
+      std::lock_guard lk(m);
+      client_fds.insert(fd);
+    }
+    auto& c = clients.emplace_back();
+    c.thread = std::jthread([&handle_client, &c, fd]{
+      handle_client(fd);
+      c.done = true;
+    });
   }
-  auto dompdf_target_path = temp_path() / "dompdf.zip" ;
-  if(!fs::exists(dompdf_target_path)){
-    extract(dompdf_rsc_p, dompdf_rsc_sz, dompdf_target_path) ;
-    auto dompdf_dir = temp_path() / "dompdf" ;
-    if(fs::exists(dompdf_dir) && !fs::is_directory(dompdf_dir)) fs::remove(dompdf_dir) ;
-    if(!fs::exists(dompdf_dir)){
-      nw::cout.flush();
-#if BOOST_OS_WINDOWS
-      std::string unzipscript = "$zip = new ZipArchive; "
-                                "if ($zip->open('dompdf.zip') === TRUE) { "
-                                "   $zip->extractTo('.'); "
-                                "   $zip->close(); "
-                                "} else { "
-                                "   exit(-1); "
-                                "}" ;
-      std::string cmd = temp_path().root_name().string() + " && cd \""
-                        + temp_path().string() + "\" && php.exe -r \"" + unzipscript + "\"";
-#else
-      std::string unzipscript = "\\$zip = new ZipArchive; "
-                                "if (\\$zip->open('dompdf.zip') === TRUE) { "
-                                "   \\$zip->extractTo('.'); "
-                                "   \\$zip->close(); "
-                                "} else { "
-                                "   exit(-1); "
-                                "}" ;
-      std::string cmd = "cd \"" + temp_path().string() + "\" && ./php.exe -r \"" + unzipscript + "\"";
-#endif
-      if( nw::system(cmd.c_str()) )
-        throw std::runtime_error("Can't unzip 'dompdf.zip' file");
+  if(!stopping) {
+    // accept() failed by itself; the signal thread is woken by a signal to this process
+    stopping = true;
+    signal_thread.request_stop();
+    kill(getpid(), SIGTERM);
+  }
+  signal_thread.join();
+  close(listen_fd);
+  fs::remove(socket_path);
+  // connections stop reading requests; jobs already queued are converted and answered
+  {
+    std::lock_guard lk(m);
+    for(int fd: client_fds) shutdown(fd, SHUT_RD);
+  }
+  clients.clear();
+}
+
+
+// function convert files by daemon
+void html2pdf_client(const std::vector<fs::path>& in_files, const std::vector<fs::path>& out_files, const po::variables_map& opts)
+{
+  signal(SIGPIPE, SIG_IGN);
+  std::string socket_path = opts["client"].as<std::string>();
+  auto connect_daemon = [&socket_path](){
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) throw std::runtime_error("Can't create socket: " + std::string(strerror(errno)));
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+      close(fd);
+      throw std::runtime_error("Can't connect to " + socket_path + ": " + strerror(errno));
     }
+    return fd;
+  };
+
+  if(in_files.empty()) {
+    int fd = connect_daemon();
+    std::string stats;
+    bool ok = write_all(fd, "STATS\n") && read_line(fd, stats);
+    close(fd);
+    if(!ok) throw std::runtime_error("Can't read daemon statistics");
+    nw::cout << stats << '\n';
+    return;
+  }
+
+  // only explicitly specified Dompdf options override the daemon ones
+  std::string overrides;
+  auto dopts = dompdf_options();
+  for(const auto& o: dopts.options()) {
+    const auto& name = o->long_name();
+    if(opts.count(name) && !opts[name].defaulted()) overrides += name + '=' + option_value_str(opts[name]) + '\n';
+  }
+
+  std::vector<std::string> errors(in_files.size());
+  std::atomic<size_t> next_job {};
+  auto worker = [&](){
+    int fd = -1;
+    for(size_t i = next_job++; i < in_files.size(); i = next_job++) {
+      try {
+        nw::ifstream is(in_files[i], std::ios::binary);
+        if(!is.is_open()) throw std::runtime_error("can't open file");
+        std::string html { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+        std::string request = "RENDER " + std::to_string(overrides.size()) + ' ' + std::to_string(html.size()) + '\n';
+        std::string status, data;
+        // daemon replies BUSY when its queue is full; retry with growing delay
+        for(auto delay = std::chrono::milliseconds(50); ; delay = std::min(delay * 2, std::chrono::milliseconds(2000))) {
+          if(fd < 0) fd = connect_daemon();
+          if(!write_all(fd, request) || !write_all(fd, overrides) || !write_all(fd, html) || !read_reply(fd, status, data)) {
+            close(fd);
+            fd = -1;
+            throw std::runtime_error("connection to daemon is lost");
+          }
+          if(status != "BUSY") break;
+          std::this_thread::sleep_for(delay);
+        }
+        if(status != "OK") throw std::runtime_error(data);
+        nw::ofstream os(out_files[i], std::ios::binary);
+        if(!os.is_open() || !os.write(data.data(), data.size())) throw std::runtime_error("can't write to file: " + out_files[i].string());
+      }
+      catch(const std::exception& e) {
+        errors[i] = e.what();
+      }
+    }
+    if(fd >= 0) close(fd);
+  };
+  {
+    std::vector<std::jthread> workers;
+    for(size_t i=0; i<std::clamp<size_t>(opts["jobs"].as<unsigned>(), 1, in_files.size()); ++i) workers.emplace_back(worker);
+  }
+
+  auto failed_count = std::count_if(errors.begin(), errors.end(), [](const auto& e){ return !e.empty(); });
+  if( failed_count ) {
+    std::string msg = "Can't convert files:\n" ;
+    for(size_t i=0; i<in_files.size(); ++i) {
+      if(!errors[i].empty()) msg += "\t" + in_files[i].string() + ": " + errors[i] + '\n';
+    }
+    msg += std::to_string(failed_count) + " of " + std::to_string(in_files.size()) + " files failed to convert";
+    throw std::runtime_error(msg);
   }
 }
+
+
+// function convert documents from stdin or input files to stdout by converter, without temp files;
+// with --stream-framing=nul or --stream-framing=length several documents are read from stdin,
+// separated by NUL bytes or each preceded by "<len>\n" line, and every result is written
+// to stdout as "ok <pdf_len>\n" <pdf> or "error <message_len>\n" <message>, in order of documents
+void html2pdf_stream(const std::vector<fs::path>& in_files, const po::variables_map& opts)
+{
+  signal(SIGPIPE, SIG_IGN);
+  auto framing = opts["stream-framing"].as<std::string>();
+
+  bool from_stdin = in_files.size()==1 && in_files.front()=="-";
+  std::string pending;   // data read from stdin, but not yet consumed
+  bool eof {};
+  auto fill = [&pending, &eof](){
+    char buf[65536];
+    for(;;) {
+      auto n = ::read(STDIN_FILENO, buf, sizeof(buf));
+      if(n < 0 && errno == EINTR) continue;
+      if(n <= 0) eof = true;
+      else pending.append(buf, n);
+      return !eof;
+    }
+  };
+  size_t next_file {};
+  auto next_document = [&](std::string& html){
+    if(!from_stdin) {
+      if(next_file >= in_files.size()) return false;
+      nw::ifstream is(in_files[next_file], std::ios::binary);
+      if(!is.is_open()) throw std::runtime_error("Can't open file: " + in_files[next_file].string());
+      html.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+      ++next_file;
+      return true;
+    }
+    if(framing == "nul") {
+      size_t pos;
+      while((pos = pending.find('\0')) == pending.npos && fill());
+      if(pos == pending.npos) {
+        if(pending.empty()) return false;
+        pos = pending.size();
+      }
+      html = pending.substr(0, pos);
+      pending.erase(0, std::min(pos + 1, pending.size()));
+      return true;
+    }
+    if(framing == "length") {
+      size_t pos;
+      while((pos = pending.find('\n')) == pending.npos && fill());
+      if(pos == pending.npos) {
+        if(pending.find_first_not_of(" \t\r\n") == pending.npos) return false;
+        throw std::runtime_error("bad frame header in standard input");
+      }
+      size_t len {};
+      if(!(std::istringstream(pending.substr(0, pos)) >> len)) throw std::runtime_error("bad frame header in standard input");
+      pending.erase(0, pos + 1);
+      while(pending.size() < len && fill());
+      if(pending.size() < len) throw std::runtime_error("unexpected end of standard input");
+      html = pending.substr(0, len);
+      pending.erase(0, len);
+      return true;
+    }
+    if(eof) return false;
+    while(fill());
+    html = std::move(pending);
+    pending.clear();
+    return true;
+  };
+
+  converter conv(library_options(opts));
+  std::string html;
+  if(framing == "none") {
+    if(!next_document(html)) return;
+    auto pdf = conv.convert(html).get();
+    if(!write_all(STDOUT_FILENO, reinterpret_cast<const char*>(pdf.data()), pdf.size()))
+      throw std::runtime_error("Can't write to standard output");
+    return;
+  }
+
+  // up to --jobs documents are converted at the same time, while results are written in order
+  std::deque<std::future<std::vector<std::byte>>> results;
+  size_t failed_count {}, count {};
+  auto write_result = [&](){
+    std::string reply;
+    try {
+      auto pdf = results.front().get();
+      reply = "ok " + std::to_string(pdf.size()) + '\n';
+      reply.append(reinterpret_cast<const char*>(pdf.data()), pdf.size());
+    }
+    catch(const std::exception& e) {
+      reply = "error " + std::to_string(std::strlen(e.what())) + '\n' + e.what();
+      ++failed_count;
+    }
+    results.pop_front();
+    if(!write_all(STDOUT_FILENO, reply)) throw std::runtime_error("Can't write to standard output");
+  };
+  for(; next_document(html); ++count) {
+    results.push_back(conv.convert(html));
+    if(results.size() >= conv.options().jobs) write_result();
+  }
+  while(!results.empty()) write_result();
+  if(failed_count)
+    throw std::runtime_error(std::to_string(failed_count) + " of " + std::to_string(count) + " documents failed to convert");
+}
+
+#else
+
+void serve(const po::variables_map&)
+{
+  throw std::runtime_error("the option 'serve' is not supported on this platform");
+}
+
+void html2pdf_client(const std::vector<fs::path>&, const std::vector<fs::path>&, const po::variables_map&)
+{
+  throw std::runtime_error("the option 'client' is not supported on this platform");
+}
+
+void html2pdf_stream(const std::vector<fs::path>&, const po::variables_map&)
+{
+  throw std::runtime_error("conversion to standard output is not supported on this platform");
+}
+
+#endif
+
+
@@ -0,0 +1,1459 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <iomanip>
+#include <ctime>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <charconv>
+#include <optional>
+#include <type_traits>
+#include <future>
+#include <boost/nowide/cstdlib.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/tokenizer.hpp>
+#include <boost/predef.h>
+#if BOOST_OS_UNIX
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+#if BOOST_OS_LINUX
+#include <sys/mman.h>
+#ifndef MFD_EXEC
+#define MFD_EXEC 0x0010U
+#endif
+#endif
+#if BOOST_OS_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+#include "miniz.h"
+#include "embed_resources.h"
+#include "sha256.h"
+#include "pdf_merge.h"
+#include "dompdfui_internal.h"
+
+namespace dompdfui {
+
+namespace fs = std::filesystem ;
+namespace nw = boost::nowide;
+
+
+fs::path php_exe_path;
+
+
+// function return seconds elapsed since given time point
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// function return description of process exit status
+std::string process_result::status_str() const
+{
+#if BOOST_OS_UNIX
+  if(signal) return "killed by signal " + std::to_string(signal) + " (" + strsignal(signal) + ")";
+#endif
+  return "exit code " + std::to_string(exit_code);
+}
+
+
+#if BOOST_OS_UNIX
+
+// function start process in given directory; process stdin is connected to in_fd or to /dev/null
+// if in_fd is -1, stdout and stderr are connected to out_fd and err_fd or inherited if they are -1
+pid_t spawn_process(const fs::path& exe, const std::vector<std::string>& args, const fs::path& dir,
+                    int in_fd, int out_fd, int err_fd)
+{
+  std::vector<std::string> args_ { exe.string() };
+  args_.insert(args_.end(), args.begin(), args.end());
+  std::vector<char*> argv;
+  for(auto& e: args_) argv.push_back(e.data());
+  argv.push_back(nullptr);
+  auto dir_ = dir.string();
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  if(in_fd >= 0) posix_spawn_file_actions_adddup2(&fa, in_fd, STDIN_FILENO);
+  else posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  if(out_fd >= 0) posix_spawn_file_actions_adddup2(&fa, out_fd, STDOUT_FILENO);
+  if(err_fd >= 0) posix_spawn_file_actions_adddup2(&fa, err_fd, STDERR_FILENO);
+  posix_spawn_file_actions_addchdir_np(&fa, dir_.c_str());
+  // signals blocked by the calling thread, like SIGPIPE by supervisor of worker, are not blocked in the child
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t empty;
+  sigemptyset(&empty);
+  posix_spawnattr_setsigmask(&attr, &empty);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  pid_t pid;
+  int err = posix_spawn(&pid, args_.front().c_str(), &fa, &attr, argv.data(), environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+  if(err) throw std::runtime_error("Can't start '" + exe.string() + "': " + strerror(err));
+  return pid;
+}
+
+
+// function run process in given directory and wait for its completion;
+// stdout and stderr of process are captured through pipes
+process_result run_process(const fs::path& exe, const std::vector<std::string>& args, const fs::path& dir)
+{
+  int out_pipe[2], err_pipe[2];
+  if(pipe2(out_pipe, O_CLOEXEC)) throw std::runtime_error("Can't create pipe: " + std::string(strerror(errno)));
+  if(pipe2(err_pipe, O_CLOEXEC)) {
+    close(out_pipe[0]);
+    close(out_pipe[1]);
+    throw std::runtime_error("Can't create pipe: " + std::string(strerror(errno)));
+  }
+  pid_t pid;
+  auto start = std::chrono::steady_clock::now();
+  process_result r;
+  try {
+    pid = spawn_process(exe, args, dir, -1, out_pipe[1], err_pipe[1]);
+    r.spawn_time = seconds_since(start);
+  }
+  catch(...) {
+    for(int fd: {out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) close(fd);
+    throw;
+  }
+  close(out_pipe[1]);
+  close(err_pipe[1]);
+  pollfd fds[2] { {out_pipe[0], POLLIN, 0}, {err_pipe[0], POLLIN, 0} };
+  std::string* bufs[2] { &r.out, &r.err };
+  char buf[65536];
+  for(int open_count = 2; open_count; ) {
+    if(poll(fds, 2, -1) < 0) {
+      if(errno == EINTR) continue;
+      break;
+    }
+    for(int i=0; i<2; ++i) {
+      if(fds[i].fd < 0 || !fds[i].revents) continue;
+      auto n = ::read(fds[i].fd, buf, sizeof(buf));
+      if(n > 0) {
+        bufs[i]->append(buf, n);
+      } else if(n == 0 || errno != EINTR) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        --open_count;
+      }
+    }
+  }
+  for(auto& e: fds) if(e.fd >= 0) close(e.fd);
+  int status {};
+  rusage ru {};
+  while(wait4(pid, &status, 0, &ru) < 0 && errno == EINTR);
+  r.wall_time = seconds_since(start);
+  r.user_time = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+  r.sys_time = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+  r.max_rss = ru.ru_maxrss;
+  if(WIFEXITED(status)) r.exit_code = WEXITSTATUS(status);
+  else if(WIFSIGNALED(status)) r.signal = WTERMSIG(status);
+  return r;
+}
+
+#else
+
+// function run process in given directory and wait for its completion;
+// output of process is not captured on this platform
+process_result run_process(const fs::path& exe, const std::vector<std::string>& args, const fs::path& dir)
+{
+  std::string cmd = dir.root_name().string() + " && cd \"" + dir.string() + "\" && \"" + exe.string() + '"';
+  for(const auto& e: args) cmd += " \"" + e + '"';
+  process_result r;
+  auto start = std::chrono::steady_clock::now();
+  r.exit_code = nw::system(cmd.c_str());
+  r.wall_time = seconds_since(start);
+  return r;
+}
+
+#endif
+
+
+// function write php script to temp directory and return its path
+fs::path write_php_script(const std::string& prefix, const std::string& content)
+{
+  auto now = std::chrono::system_clock::now();
+  auto now_c = std::chrono::system_clock::to_time_t(now);
+  auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+  std::tm *local_time = std::localtime(&now_c);
+  std::stringstream ss;
+  ss << prefix << std::put_time(local_time, "_%d%B%Y_%Hh%Mm%Ss") << std::setfill('0')
+     << std::setw(3) << milliseconds.count() << "ms_" << std::hex << std::random_device()() << ".php" ;
+  auto script_path = temp_path() / ss.str() ;
+  nw::ofstream script( script_path ) ;
+  if(!script.is_open()) throw std::runtime_error("Can't open file: " + script_path.string()) ;
+  script << content ;
+  script.close();
+  return script_path;
+}
+
+
+// function create font directory of worker in temp directory; it is created by worker threads,
+// so failure isn't thrown, and fonts are installed in fontDir then
+font_install_dir::font_install_dir()
+{
+  std::stringstream ss;
+  ss << "fontdir_" << std::hex << std::random_device()() << std::random_device()();
+  path_ = temp_path() / ss.str();
+  std::error_code ec;
+  if(!fs::create_directory(path_, ec)) path_.clear();
+}
+
+
+font_install_dir::~font_install_dir()
+{
+  std::error_code ec;
+  if(!path_.empty()) fs::remove_all(path_, ec);
+}
+
+
+// function return php-cli arguments, which pass the directory to WorkerFontMetrics of php script
+std::vector<std::string> font_install_dir::php_args() const
+{
+  if(path_.empty()) return {};
+  return { "-d", "dompdfui.font_install_dir=" + path_.generic_string() };
+}
+
+
+// function generate beginning of php script: loading of dompdf library and setup of Options.
+// Font caches are frozen: fonts and metrics are read from read-only fontDir and fontCache, and fonts
+// of @font-face rules are installed by WorkerFontMetrics in font_install_dir of the worker
+std::string php_options_script(const Options& opts, bool frozen_fonts)
+{
+  auto php_array = [](const std::vector<std::string>& v){
+    std::string r;
+    if(v.empty()) return r;
+    if(std::all_of(v.begin(), v.end(), [](const auto& e){ return e.empty(); })) return r;
+    std::vector<std::string> vv;
+    using Separator = boost::char_separator<char>;
+    using Tokenizer = boost::tokenizer<Separator>;
+    Separator sep(";,");
+    for(const auto& e: v){
+      Tokenizer tokens(e, sep);
+      for (Tokenizer::iterator tok_iter = tokens.begin(); tok_iter != tokens.end(); ++tok_iter){
+        vv.push_back(*tok_iter);
+      }
+    }
+    r += '[';
+    std::for_each(vv.begin(), vv.end(), [&r](const auto& e){ r += '"' + e + "\","; });
+    r.pop_back();
+    r += ']';
+    return r;
+  };
+  std::stringstream script;
+  script <<
+    "<?php\n"
+    "require_once 'dompdf/autoload.inc.php';\n\n"
+    "use Dompdf\\Dompdf;\n"
+    "use Dompdf\\Options;\n\n"
+    "$options = new Options();\n"
+    "$options->setIsPhpEnabled("                    << opts.isPhpEnabled << ");\n"
+    "$options->setIsRemoteEnabled("                 << opts.isRemoteEnabled << ");\n"
+    "$options->setIsPdfAEnabled("                   << opts.isPdfAEnabled << ");\n"
+    "$options->setIsJavascriptEnabled("             << opts.isJavascriptEnabled << ");\n"
+    "$options->setIsHtml5ParserEnabled("            << opts.isHtml5ParserEnabled << ");\n"
+    "$options->setIsFontSubsettingEnabled("         << opts.isFontSubsettingEnabled << ");\n"
+    "$options->setDebugPng("                        << opts.debugPng << ");\n"
+    "$options->setDebugKeepTemp("                   << opts.debugKeepTemp << ");\n"
+    "$options->setDebugCss("                        << opts.debugCss << ");\n"
+    "$options->setDebugLayout("                     << opts.debugLayout << ");\n"
+    "$options->setDebugLayoutLines("                << opts.debugLayoutLines << ");\n"
+    "$options->setDebugLayoutBlocks("               << opts.debugLayoutBlocks << ");\n"
+    "$options->setDebugLayoutInline("               << opts.debugLayoutInline << ");\n"
+    "$options->setDebugLayoutPaddingBox("           << opts.debugLayoutPaddingBox << ");\n"
+    "$options->setDpi("                             << opts.dpi << ");\n"
+    "$options->setFontHeightRatio("                 << opts.fontHeightRatio << ");\n" ;
+
+  if(opts.rootDir) script <<
+    "$options->setRootDir('"                        << *opts.rootDir << "');\n" ;
+
+  if(opts.tempDir) script <<
+    "$options->setTempDir('"                        << *opts.tempDir << "');\n" ;
+
+  if(opts.fontDir) script <<
+    "$options->setFontDir('"                        << *opts.fontDir << "');\n" ;
+
+  // fonts of @font-face rules are installed in the directory given by font_install_dir::php_args(),
+  // which lives as long as the worker, and are read from there as well as from read-only fontDir;
+  // without the directory they are installed in fontDir, as by Dompdf
+  if(frozen_fonts) script <<
+    "\nclass WorkerFontMetrics extends Dompdf\\FontMetrics {\n"
+    "  private $worker_options;\n"
+    "  private $install_dir;\n\n"
+    "  public function __construct(Dompdf\\Canvas $canvas, Options $options) {\n"
+    "    $this->worker_options = $options;\n"
+    "    $this->install_dir = get_cfg_var('dompdfui.font_install_dir');\n"
+    "    parent::__construct($canvas, $options);\n"
+    "  }\n\n"
+    "  public function loadFontFamilies() {\n"
+    "    parent::loadFontFamilies();\n"
+    "    if (!$this->install_dir) return;\n"
+    "    $file = $this->install_dir . '/installed-fonts.json';\n"
+    "    $fonts = is_readable($file) ? json_decode(file_get_contents($file), TRUE) : NULL;\n"
+    "    if (is_array($fonts)) foreach ($fonts as $family => $entries) $this->setFontFamily($family, $entries);\n"
+    "  }\n\n"
+    "  public function registerFont($style, $remoteFile, $context = NULL) {\n"
+    "    if (!$this->install_dir) return parent::registerFont($style, $remoteFile, $context);\n"
+    "    $font_dir = $this->worker_options->getFontDir();\n"
+    "    $this->worker_options->setFontDir($this->install_dir);\n"
+    "    try {\n"
+    "      return parent::registerFont($style, $remoteFile, $context);\n"
+    "    } finally {\n"
+    "      $this->worker_options->setFontDir($font_dir);\n"
+    "    }\n"
+    "  }\n"
+    "}\n\n" ;
+
+  // metrics of fonts registered in fontDir by --register-fonts are cached there, and of bundled fonts
+  // in the runtime, when it is published
+  if(opts.fontCache) script <<
+    "$options->setFontCache('"                      << *opts.fontCache << "');\n" ;
+  else if(opts.fontDir) script <<
+    "$options->setFontCache('"                      << *opts.fontDir << "');\n" ;
+  else script <<
+    "$options->setFontCache('"                      << runtime_fonts_path().generic_string() << "');\n" ;
+
+  if(opts.logOutputFile) script <<
+    "$options->setLogOutputFile('"                  << *opts.logOutputFile << "');\n" ;
+
+  script <<
+    "$options->setDefaultMediaType('"               << opts.defaultMediaType << "');\n"
+    "$options->setDefaultPaperSize('"               << opts.defaultPaperSize << "');\n"
+    "$options->setDefaultPaperOrientation('"        << opts.defaultPaperOrientation << "');\n"
+    "$options->setDefaultFont('"                    << opts.defaultFont << "');\n"
+    "$options->setPdfBackend('"                     << opts.pdfBackend << "');\n" ;
+
+  if(opts.pdflibLicense) script <<
+    "$options->setPdflibLicense('"                  << *opts.pdflibLicense << "');\n" ;
+
+  if(!opts.chroot.empty()) script <<
+    "$options->setChroot(" << php_array(opts.chroot) << ");\n" ;
+
+  // documents reference copies of assets and optimized images in their caches
+  std::vector<std::string> cache_dirs;
+  for(const auto& dir: { opts.asset_cache, opts.image_cache }) if(dir) cache_dirs.push_back(fs::absolute(*dir).generic_string());
+  if(!cache_dirs.empty()) script <<
+    "$options->setChroot(array_merge($options->getChroot(), " << php_array(cache_dirs) << "));\n" ;
+
+  if(!opts.allowedRemoteHosts.empty()) script <<
+    "$options->setAllowedRemoteHosts(" << php_array(opts.allowedRemoteHosts) <<
+    ");\n" ;
+
+  return script.str();
+}
+
+
+// function return php-cli arguments, which set ini directives common for all conversions
+std::vector<std::string> php_ini_args(const Options& opts)
+{
+  std::vector<std::string> args { "-d", "memory_limit=" + std::to_string(opts.php_memory_limit) };
+  if(opts.opcache) {
+    // runtime never changes after it is published, so compiled scripts are valid as long as it exists;
+    // generated scripts have unique names and are blacklisted, not to litter the cache
+    auto dir = temp_path();
+    for(std::string e: { "opcache.enable_cli=1", "opcache.validate_timestamps=0" })
+      args.insert(args.end(), { "-d", e });
+    args.insert(args.end(), { "-d", "opcache.file_cache=" + (dir / "opcache").string(),
+                              "-d", "opcache.blacklist_filename=" + (dir / "opcache_blacklist.txt").string() });
+#if BOOST_OS_UNIX
+    // preloading is not supported on Windows
+    if(fs::exists(dir / "preload.php")) {
+      args.insert(args.end(), { "-d", "opcache.preload=" + (dir / "preload.php").string() });
+      if(!geteuid()) args.insert(args.end(), { "-d", "opcache.preload_user=root" });
+    }
+#endif
+  }
+  return args;
+}
+
+
+// function allow or deny writing to directory and to its files; frozen font caches are written once
+// and read by all processes (permissions are changed on Unix only)
+void set_writable(const fs::path& dir, bool writable)
+{
+#if BOOST_OS_UNIX
+  auto perms = fs::perms::owner_write | fs::perms::group_write | fs::perms::others_write;
+  auto mode = writable ? fs::perm_options::add : fs::perm_options::remove;
+  std::error_code ec;
+  if(!fs::is_directory(dir, ec)) return;
+  for(const auto& e: fs::directory_iterator(dir, ec)) {
+    if(e.is_regular_file(ec)) fs::permissions(e.path(), writable ? fs::perms::owner_write : perms, mode, ec);
+  }
+  fs::permissions(dir, writable ? fs::perms::owner_write : perms, mode, ec);
+#else
+  (void)dir; (void)writable;
+#endif
+}
+
+
+// function return php code, which parses metrics of all fonts known to $fontMetrics,
+// so that they are saved to fontCache directory once instead of being parsed by renders
+std::string php_fonts_warmup_script()
+{
+  return
+    "foreach ($fontMetrics->getFontFamilies() as $variants) {\n"
+    "  foreach ($variants as $file) {\n"
+    "    if (is_string($file) && (is_file(\"$file.ufm\") || is_file(\"$file.afm\"))) {\n"
+    "      $fontMetrics->getTextWidth('x', $file, 12);\n"
+    "    }\n"
+    "  }\n"
+    "}\n" ;
+}
+
+
+#if BOOST_OS_UNIX
+
+// Converter feeds php-cli workers through their stdin and stdout, each request and reply starts
+// with a text line, which is followed by binary data:
+//     converter: "<options_len> <html_len>\n" <options> <html>
+//                options are "name=value\n" lines, overriding Dompdf options of the worker for this job
+//     worker:    "ok <pdf_len>\n" <pdf>  |  "error <message_len>\n" <message>
+
+bool write_all(int fd, const char* p, size_t n)
+{
+  while(n) {
+    auto r = ::write(fd, p, n);
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool write_all(int fd, const std::string& s)
+{
+  return write_all(fd, s.data(), s.size());
+}
+
+bool read_exact(int fd, char* p, size_t n)
+{
+  while(n) {
+    auto r = ::read(fd, p, n);
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool read_line(int fd, std::string& line)
+{
+  line.clear();
+  for(char c; ; ) {
+    if(!read_exact(fd, &c, 1)) return false;
+    if(c == '\n') return true;
+    if(line.size() > 4096) return false;
+    line += c;
+  }
+}
+
+// function read reply in form "<status> <len>\n" <data>
+bool read_reply(int fd, std::string& status, std::string& data)
+{
+  std::string line;
+  size_t len {};
+  if(!read_line(fd, line)) return false;
+  std::istringstream is(line);
+  if(!(is >> status >> len)) return false;
+  if(status == "BUSY") return true;
+  data.resize(len);
+  return read_exact(fd, data.data(), len);
+}
+
+
+// function start php-cli worker in temp directory; its stderr is written to an unlinked file in append mode,
+// which doesn't block the worker like a pipe nobody reads, and can be truncated before each job
+php_worker spawn_php_worker(const std::vector<std::string>& args)
+{
+  auto err_name = (temp_path() / "worker_stderr_XXXXXX").string();
+  int err_fd = mkostemp(err_name.data(), O_APPEND | O_CLOEXEC);
+  if(err_fd < 0) throw std::runtime_error("Can't create file: " + err_name + ": " + strerror(errno));
+  unlink(err_name.c_str());
+  int in_pipe[2], out_pipe[2];
+  if(pipe2(in_pipe, O_CLOEXEC)) {
+    close(err_fd);
+    throw std::runtime_error("Can't create pipe: " + std::string(strerror(errno)));
+  }
+  if(pipe2(out_pipe, O_CLOEXEC)) {
+    for(int fd: {in_pipe[0], in_pipe[1], err_fd}) close(fd);
+    throw std::runtime_error("Can't create pipe: " + std::string(strerror(errno)));
+  }
+  php_worker w;
+  try {
+    w.pid = spawn_process(php_exe_path, args, temp_path(), in_pipe[0], out_pipe[1], err_fd);
+  }
+  catch(...) {
+    for(int fd: {in_pipe[0], in_pipe[1], out_pipe[0], out_pipe[1], err_fd}) close(fd);
+    throw;
+  }
+  close(in_pipe[0]);
+  close(out_pipe[1]);
+  w.in = in_pipe[1];
+  w.out = out_pipe[0];
+  w.err = err_fd;
+  return w;
+}
+
+// function stop php-cli worker; worker exits by itself when its stdin is closed
+void stop_php_worker(php_worker& w, bool kill_it)
+{
+  if(w.pid < 0) return;
+  if(kill_it) ::kill(w.pid, SIGKILL);
+  close(w.in);
+  close(w.out);
+  close(w.err);
+  while(waitpid(w.pid, nullptr, 0) < 0 && errno == EINTR);
+  w = {};
+}
+
+// function return the last line, which php-cli worker wrote to stderr, e.g. its fatal error
+std::string php_worker_error(const php_worker& w)
+{
+  struct stat st {};
+  if(w.err < 0 || fstat(w.err, &st)) return {};
+  std::string text(std::min<off_t>(st.st_size, 4096), '\0');
+  auto n = pread(w.err, text.data(), text.size(), st.st_size - off_t(text.size()));
+  text.resize(std::max<ssize_t>(n, 0));
+  auto end = text.find_last_not_of(" \t\r\n");
+  if(end == text.npos) return {};
+  auto begin = text.find_last_of('\n', end);
+  begin = text.find_first_not_of(" \t", begin == text.npos ? 0 : begin + 1);
+  return text.substr(begin, end + 1 - begin);
+}
+
+// function return resident set size of process in bytes
+unsigned long long process_rss(pid_t pid)
+{
+  nw::ifstream statm("/proc/" + std::to_string(pid) + "/statm");
+  unsigned long long size {}, resident {};
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+
+// function generate php script of worker, which converts documents received through its stdin
+std::string php_worker_script(const Options& opts)
+{
+  std::stringstream script;
+  script << php_options_script(opts) <<
+    "ini_set('display_errors', 'stderr');\n"
+    "$allow_self_signed = " << opts.sslAllowSelfSigned << ";\n"
+    "$fontMetrics = NULL;\n\n"
+    "function read_exact($len) {\n"
+    "  $r = '';\n"
+    "  while (strlen($r) < $len) {\n"
+    "    $chunk = fread(STDIN, $len - strlen($r));\n"
+    "    if ($chunk === FALSE || $chunk === '') exit(-1);\n"
+    "    $r .= $chunk;\n"
+    "  }\n"
+    "  return $r;\n"
+    "}\n\n"
+    "while (($header = fgets(STDIN)) !== FALSE) {\n"
+    "  [$options_len, $html_len] = array_map('intval', explode(' ', trim($header)));\n"
+    "  $overrides = read_exact($options_len);\n"
+    "  $html_content = read_exact($html_len);\n"
+    "  $job_options = clone $options;\n"
+    "  $job_allow_self_signed = $allow_self_signed;\n"
+    "  foreach (explode(\"\\n\", $overrides) as $line) {\n"
+    "    if ($line === '') continue;\n"
+    "    [$key, $value] = explode('=', $line, 2);\n"
+    "    if ($key === 'sslAllowSelfSigned') { $job_allow_self_signed = (bool)$value; continue; }\n"
+    "    if ($key === 'chroot' || $key === 'allowedRemoteHosts') $value = explode(',', $value);\n"
+    "    $job_options->set($key, $value);\n"
+    "  }\n"
+    "  ob_start();\n"
+    "  try {\n"
+    "    $dompdf = new Dompdf($job_options);\n"
+    "    if ($overrides !== '') {\n"
+    "      $dompdf->setFontMetrics(new WorkerFontMetrics($dompdf->getCanvas(), $job_options));\n"
+    "    } else if ($fontMetrics === NULL) {\n"
+    "      $fontMetrics = new WorkerFontMetrics($dompdf->getCanvas(), $job_options);\n"
+    "      $dompdf->setFontMetrics($fontMetrics);\n"
+    "    } else {\n"
+    "      $fontMetrics->setCanvas($dompdf->getCanvas());\n"
+    "      $dompdf->setFontMetrics($fontMetrics);\n"
+    "    }\n"
+    "    if ($job_options->getIsRemoteEnabled() && $job_allow_self_signed) {\n"
+    "      $dompdf->setHttpContext(stream_context_create([\n"
+    "        'ssl' => [\n"
+    "          'verify_peer' => FALSE,\n"
+    "          'verify_peer_name' => FALSE,\n"
+    "          'allow_self_signed'=> TRUE\n"
+    "        ]\n"
+    "      ]));\n"
+    "    }\n"
+    "    $dompdf->loadHtml($html_content);\n"
+    "    $dompdf->render();\n"
+    "    $reply = 'ok';\n"
+    "    $data = $dompdf->output();\n"
+    "  } catch (Throwable $e) {\n"
+    "    $reply = 'error';\n"
+    "    $data = $e->getMessage();\n"
+    "  }\n"
+    "  ob_end_clean();\n"
+    "  fwrite(STDOUT, $reply . ' ' . strlen($data) . \"\\n\" . $data);\n"
+    "  fflush(STDOUT);\n"
+    "  unset($dompdf, $html_content, $data);\n"
+    "}\n" ;
+  return script.str();
+}
+
+#endif
+
+
+// function return key of embedded runtime, derived from content of resources
+const std::string& runtime_key()
+{
+  static const auto key = sha256().update(embedded::resource<"php.exe">().sha256())
+                                  .update(embedded::resource<"dompdf.zip">().sha256()).hexdigest().substr(0, 16);
+  return key;
+}
+
+
+// function return application specific temp path, where runtime is extracted;
+// instances built with the same resources share it
+fs::path temp_path()
+{
+  std::string dir_name = "dompdfui_" + runtime_key();
+  return fs::temp_directory_path() / dir_name ;
+}
+
+
+// function return directory of fonts bundled with Dompdf in the runtime, which is their frozen font cache
+fs::path runtime_fonts_path()
+{
+  return temp_path() / "dompdf" / "lib" / "fonts";
+}
+
+
+// advisory lock of file, the same for all processes; shared lock is held while the runtime
+// is used, and exclusive lock while it is published or removed
+class file_lock {
+public:
+  explicit file_lock(const fs::path& path)
+  {
+#if BOOST_OS_WINDOWS
+    handle_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(handle_ == INVALID_HANDLE_VALUE) throw std::runtime_error("Can't open file: " + path.string());
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if(fd_ < 0) throw std::runtime_error("Can't open file: " + path.string() + ": " + std::strerror(errno));
+#endif
+  }
+  file_lock(const file_lock&) = delete;
+  file_lock& operator=(const file_lock&) = delete;
+  ~file_lock()
+  {
+#if BOOST_OS_WINDOWS
+    CloseHandle(handle_);
+#else
+    ::close(fd_);
+#endif
+  }
+  void lock_shared() { if(!acquire(false, true)) throw std::runtime_error("Can't lock runtime directory"); }
+  void lock() { if(!acquire(true, true)) throw std::runtime_error("Can't lock runtime directory"); }
+  bool try_lock() { return acquire(true, false); }
+  void unlock()
+  {
+#if BOOST_OS_WINDOWS
+    OVERLAPPED ov {};
+    UnlockFileEx(handle_, 0, 1, 0, &ov);
+#else
+    ::flock(fd_, LOCK_UN);
+#endif
+  }
+
+private:
+  bool acquire(bool exclusive, bool wait)
+  {
+#if BOOST_OS_WINDOWS
+    OVERLAPPED ov {};
+    DWORD flags = (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    return LockFileEx(handle_, flags, 0, 1, 0, &ov);
+#else
+    int op = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+    int r;
+    while((r = ::flock(fd_, op)) < 0 && errno == EINTR);
+    return !r;
+#endif
+  }
+
+#if BOOST_OS_WINDOWS
+  HANDLE handle_;
+#else
+  int fd_;
+#endif
+};
+
+std::unique_ptr<file_lock> runtime_lock;
+std::recursive_mutex runtime_mutex;   // guards runtime state, because converters may be created by several threads
+bool runtime_ready {};
+unsigned runtime_users {};           // converters using the runtime
+
+
+// function pass content of embedded resource to sink by chunks, decompressing it if necessary
+void read_resource(embedded::EmbeddedCollection::EmbeddedResource rsc, const std::function<void(const char*, size_t)>& sink)
+{
+  if(!rsc.compressed()) {
+    if(mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const unsigned char*>(rsc.data()), rsc.size()) != rsc.crc32())
+      throw std::runtime_error("Embedded resource is corrupted");
+    sink(rsc.data(), rsc.size());
+    return;
+  }
+  mz_stream zs {};
+  zs.next_in = reinterpret_cast<const unsigned char*>(rsc.data());
+  zs.avail_in = rsc.size();
+  if(mz_inflateInit(&zs) != MZ_OK) throw std::runtime_error("Can't initialize decompressor");
+  std::vector<unsigned char> buf(1 << 18);
+  auto checksum = mz_crc32(MZ_CRC32_INIT, nullptr, 0);
+  int status;
+  try {
+    do {
+      zs.next_out = buf.data();
+      zs.avail_out = buf.size();
+      status = mz_inflate(&zs, MZ_NO_FLUSH);
+      if(status != MZ_OK && status != MZ_STREAM_END) throw std::runtime_error("Embedded resource is corrupted");
+      size_t n = buf.size() - zs.avail_out;
+      checksum = mz_crc32(checksum, buf.data(), n);
+      sink(reinterpret_cast<const char*>(buf.data()), n);
+    } while(status != MZ_STREAM_END);
+  }
+  catch(...) {
+    mz_inflateEnd(&zs);
+    throw;
+  }
+  mz_inflateEnd(&zs);
+  if(zs.total_out != rsc.original_size() || checksum != rsc.crc32())
+    throw std::runtime_error("Embedded resource is corrupted");
+}
+
+
+// function extract zip archive from embedded resource to directory, using several threads
+void unzip_resource(embedded::EmbeddedCollection::EmbeddedResource rsc, const fs::path& dir, unsigned threads)
+{
+  std::string buf;
+  std::string_view zip_data(rsc.data(), rsc.size());
+  if(rsc.compressed()) {
+    buf.reserve(rsc.original_size());
+    read_resource(rsc, [&buf](const char* p, size_t sz){ buf.append(p, sz); });
+    zip_data = buf;
+  }
+  // each thread uses its own reader of the same memory block
+  auto open_zip = [&zip_data](mz_zip_archive& zip){
+    zip = {};
+    if(!mz_zip_reader_init_mem(&zip, zip_data.data(), zip_data.size(), 0))
+      throw std::runtime_error("Can't open embedded zip archive: "
+                               + std::string(mz_zip_get_error_string(mz_zip_get_last_error(&zip))));
+  };
+  mz_zip_archive zip;
+  open_zip(zip);
+  std::vector<std::pair<mz_uint, fs::path>> files;
+  try {
+    for(mz_uint i=0; i<mz_zip_reader_get_num_files(&zip); ++i) {
+      mz_zip_archive_file_stat stat;
+      if(!mz_zip_reader_file_stat(&zip, i, &stat)) throw std::runtime_error("Can't read embedded zip archive");
+      auto name = fs::path(stat.m_filename).lexically_normal();
+      if(name.is_absolute() || name.has_root_name() || (!name.empty() && *name.begin() == ".."))
+        throw std::runtime_error("Wrong file name in embedded zip archive: " + std::string(stat.m_filename));
+      auto path = dir / name;
+      if(stat.m_is_directory) {
+        fs::create_directories(path);
+      } else {
+        fs::create_directories(path.parent_path());
+        files.emplace_back(i, path);
+      }
+    }
+  }
+  catch(...) {
+    mz_zip_reader_end(&zip);
+    throw;
+  }
+  mz_zip_reader_end(&zip);
+
+  std::atomic<size_t> next_file {};
+  std::mutex error_mutex;
+  std::string error;
+  auto worker = [&](){
+    mz_zip_archive zip;
+    try {
+      open_zip(zip);
+    }
+    catch(const std::exception& e) {
+      std::lock_guard lk(error_mutex);
+      error = e.what();
+      return;
+    }
+    for(size_t n = next_file++; n < files.size(); n = next_file++) {
+      const auto& [index, path] = files[n];
+      nw::ofstream os ( path, std::ios::binary );
+      bool ok = os.is_open() && mz_zip_reader_extract_to_callback(&zip, index,
+        [](void* os, mz_uint64, const void* p, size_t sz) -> size_t {
+          return static_cast<nw::ofstream*>(os)->write(static_cast<const char*>(p), sz) ? sz : 0;
+        }, &os, 0);
+      os.close();
+      if(!ok || !os) {
+        std::lock_guard lk(error_mutex);
+        error = "Can't extract file: " + path.string();
+        break;
+      }
+    }
+    mz_zip_reader_end(&zip);
+  };
+  {
+    std::vector<std::jthread> workers;
+    for(size_t i=0; i<std::clamp<size_t>(threads, 1, files.size()); ++i) workers.emplace_back(worker);
+  }
+  if(!error.empty()) throw std::runtime_error(error);
+}
+
+
+#if BOOST_OS_LINUX
+
+// function load php-cli to sealed anonymous memory file and return path to execute it,
+// or empty path if memory files are not supported
+fs::path load_php_to_memory()
+{
+  // kernels before 6.3 don't know MFD_EXEC flag
+  int fd = memfd_create("php.exe", MFD_ALLOW_SEALING | MFD_EXEC);
+  if(fd < 0 && errno == EINVAL) fd = memfd_create("php.exe", MFD_ALLOW_SEALING);
+  if(fd < 0) return {};
+  try {
+    read_resource(embedded::resource<"php.exe">(), [fd](const char* p, size_t sz){
+      if(!write_all(fd, p, sz)) throw std::runtime_error(std::string("Can't write php-cli to memory: ") + std::strerror(errno));
+    });
+  }
+  catch(...) {
+    ::close(fd);
+    throw;
+  }
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+  // descriptor is inherited by child processes, because the path is resolved by the child itself;
+  // this way it works for any kind of executable, not only for ELF
+  auto path = "/proc/self/fd/" + std::to_string(fd);
+  if(::access(path.c_str(), X_OK)) {
+    ::close(fd);
+    return {};
+  }
+  return path;
+}
+
+#endif
+
+
+// function extract embedded resources to runtime directory, if it isn't published yet;
+// runtime is extracted to staging directory and published by rename, so other instances never see it
+// incomplete, and warm start is a single read of marker file
+void publish_runtime(const Options& opts)
+{
+  auto extract = [](embedded::EmbeddedCollection::EmbeddedResource rsc, const fs::path& path){
+    nw::ofstream os ( path, std::ios::binary );
+    if(!os.is_open()) throw std::runtime_error("Can't open file: " + path.string()) ;
+    os.exceptions(std::ios_base::badbit);
+    try { read_resource(rsc, [&os](const char* p, size_t sz){ os.write(p, sz); }); }
+    catch(std::ios_base::failure&) { throw std::runtime_error("Can't write to file: " + path.string()) ; }
+    os.close();
+    if(!os) throw std::runtime_error("Can't write to file: " + path.string()) ;
+  };
+  auto extract_php = [&extract](const fs::path& path){
+    extract(embedded::resource<"php.exe">(), path) ;
+#if BOOST_OS_UNIX
+    fs::permissions(path, fs::perms::owner_all | fs::perms::group_all, fs::perm_options::add);
+#endif
+  };
+#if BOOST_OS_LINUX
+  // if php-cli can't be run from memory, it is extracted as usual
+  if(opts.php_in_memory) php_exe_path = load_php_to_memory();
+#endif
+  bool need_php = php_exe_path.empty();
+  auto dir = temp_path();
+  auto marker = dir / ".complete";
+  // php.exe is not a part of marked content, it is published separately when needed
+  auto marker_content = "dompdfui runtime 2\n" + std::string(embedded::resource<"dompdf.zip">().sha256()) + " dompdf.zip\n";
+  auto published = [&](){
+    nw::ifstream is ( marker, std::ios::binary );
+    std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+    return is.is_open() && content == marker_content;
+  };
+  runtime_lock = std::make_unique<file_lock>(fs::path(dir).concat(".lock"));
+  for(;;) {
+    runtime_lock->lock_shared();
+    if(published()) break;
+    runtime_lock->unlock();
+    runtime_lock->lock();
+    if(!published()) {
+      auto staging = fs::path(dir).concat(".staging");
+      set_writable(staging / "dompdf" / "lib" / "fonts", true);
+      fs::remove_all(staging);
+      fs::create_directory(staging);
+      if(need_php) extract_php(staging / "php.exe") ;
+      if(!opts.no_zip_copy)
+        extract(embedded::resource<"dompdf.zip">(), staging / "dompdf.zip") ;
+      unzip_resource(embedded::resource<"dompdf.zip">(), staging, std::max(1u, opts.jobs)) ;
+      // runtime is warmed up before it is published: metrics of bundled fonts are cached in default
+      // fontCache, and Dompdf sources used by a sample render are listed for opcache preloading.
+      // Then the font cache is frozen: renders only read it, and install fonts of @font-face rules in font directory
+      // of their worker. Failure isn't fatal, renders would parse metrics of the fonts they use
+      fs::create_directory(staging / "opcache");
+      nw::ofstream blacklist ( staging / "opcache_blacklist.txt" );
+      for(auto prefix: { "html2pdf_", "worker_", "fonts_" }) blacklist << (dir / prefix).string() << "*\n";
+      blacklist.close();
+      auto warmup_script = staging / "warmup.php";
+      nw::ofstream warmup ( warmup_script );
+      warmup << "<?php\n"
+                "require_once 'dompdf/autoload.inc.php';\n\n"
+                "use Dompdf\\Dompdf;\n\n"
+                "$dompdf = new Dompdf();\n"
+                "$fontMetrics = $dompdf->getFontMetrics();\n"
+             << php_fonts_warmup_script() <<
+                "$dompdf->loadHtml('<html><head><style>td { font-weight: bold; }</style></head>'\n"
+                "                  . '<body><table><tr><td>x</td></tr></table><ul><li>x</li></ul></body></html>');\n"
+                "$dompdf->render();\n"
+                "$dompdf->output();\n"
+                "$base = getcwd() . DIRECTORY_SEPARATOR;\n"
+                "$files = [];\n"
+                "foreach (get_included_files() as $file) {\n"
+                "  if ($file !== __FILE__ && strncmp($file, $base, strlen($base)) === 0) $files[] = substr($file, strlen($base));\n"
+                "}\n"
+                "file_put_contents('preload.php', \"<?php\\nforeach (\" . var_export($files, TRUE)\n"
+                "                  . \" as \\$file) require_once __DIR__ . '/' . \\$file;\\n\");\n" ;
+      warmup.close();
+      if(warmup) run_process(need_php ? staging / "php.exe" : php_exe_path, {warmup_script.filename().string()}, staging);
+      fs::remove(warmup_script);
+      set_writable(staging / "dompdf" / "lib" / "fonts", false);
+      nw::ofstream os ( staging / ".complete", std::ios::binary );
+      os << marker_content;
+      os.close();
+      if(!os) throw std::runtime_error("Can't write to file: " + (staging / ".complete").string()) ;
+      // directory without marker is left by crashed instance
+      set_writable(runtime_fonts_path(), true);
+      fs::remove_all(dir);
+      fs::rename(staging, dir);
+    }
+    // exclusive lock is released, so the runtime may be removed before shared lock is taken; check it again
+    runtime_lock->unlock();
+  }
+  if(!need_php) return;
+  php_exe_path = dir / "php.exe";
+  if(fs::exists(php_exe_path)) return;
+  // runtime was published by instance running php-cli from memory; shared lock is enough here,
+  // because concurrent instances write the same content and rename is atomic
+  auto tmp_path = dir / ("php.exe." + std::to_string(std::random_device()()));
+  extract_php(tmp_path) ;
+  std::error_code ec;
+  fs::rename(tmp_path, php_exe_path, ec);
+  if(ec) {
+    fs::remove(tmp_path);
+    if(!fs::exists(php_exe_path)) throw std::runtime_error("Can't write to file: " + php_exe_path.string()) ;
+  }
+}
+
+
+// function prepare runtime for use by this process; it is done once, unless the runtime is removed
+void extract_embedded_resources(const Options& opts)
+{
+  std::lock_guard lk(runtime_mutex);
+  if(runtime_ready) return;
+  php_exe_path.clear();
+  publish_runtime(opts);
+  runtime_ready = true;
+}
+
+
+// function remove runtime directory, unless other instances use it
+void remove_runtime()
+{
+  std::error_code ec;
+  std::lock_guard lk(runtime_mutex);
+  if(!runtime_lock) return;
+  runtime_ready = false;
+  runtime_lock->unlock();
+  if(runtime_lock->try_lock()) {
+    // marker is removed first, so partially removed directory is never taken for complete one
+    fs::remove(temp_path() / ".complete", ec);
+    set_writable(runtime_fonts_path(), true);
+    fs::remove_all(temp_path(), ec);
+    runtime_lock->unlock();
+  }
+  runtime_lock.reset();
+}
+
+
+// function call f(name, pointer to member) for every Dompdf option
+template<class F> void for_each_dompdf_option(F&& f)
+{
+  f("isPhpEnabled", &Options::isPhpEnabled);
+  f("isRemoteEnabled", &Options::isRemoteEnabled);
+  f("isPdfAEnabled", &Options::isPdfAEnabled);
+  f("isJavascriptEnabled", &Options::isJavascriptEnabled);
+  f("isHtml5ParserEnabled", &Options::isHtml5ParserEnabled);
+  f("isFontSubsettingEnabled", &Options::isFontSubsettingEnabled);
+  f("sslAllowSelfSigned", &Options::sslAllowSelfSigned);
+  f("debugPng", &Options::debugPng);
+  f("debugKeepTemp", &Options::debugKeepTemp);
+  f("debugCss", &Options::debugCss);
+  f("debugLayout", &Options::debugLayout);
+  f("debugLayoutLines", &Options::debugLayoutLines);
+  f("debugLayoutBlocks", &Options::debugLayoutBlocks);
+  f("debugLayoutInline", &Options::debugLayoutInline);
+  f("debugLayoutPaddingBox", &Options::debugLayoutPaddingBox);
+  f("dpi", &Options::dpi);
+  f("fontHeightRatio", &Options::fontHeightRatio);
+  f("rootDir", &Options::rootDir);
+  f("tempDir", &Options::tempDir);
+  f("fontDir", &Options::fontDir);
+  f("fontCache", &Options::fontCache);
+  f("logOutputFile", &Options::logOutputFile);
+  f("defaultMediaType", &Options::defaultMediaType);
+  f("defaultPaperSize", &Options::defaultPaperSize);
+  f("defaultPaperOrientation", &Options::defaultPaperOrientation);
+  f("defaultFont", &Options::defaultFont);
+  f("pdfBackend", &Options::pdfBackend);
+  f("pdflibLicense", &Options::pdflibLicense);
+  f("chroot", &Options::chroot);
+  f("allowedRemoteHosts", &Options::allowedRemoteHosts);
+}
+
+
+// functions convert value of option from and to the form of command line
+void parse_option_value(bool& v, std::string_view s)
+{
+  if(s == "1" || s == "true" || s == "yes" || s == "on") v = true;
+  else if(s == "0" || s == "false" || s == "no" || s == "off") v = false;
+  else throw std::invalid_argument("not a boolean");
+}
+
+template<class T> requires std::is_arithmetic_v<T> void parse_option_value(T& v, std::string_view s)
+{
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+  if(ec != std::errc() || end != s.data() + s.size()) throw std::invalid_argument("not a number");
+}
+
+void parse_option_value(std::string& v, std::string_view s) { v = s; }
+
+void parse_option_value(std::optional<std::string>& v, std::string_view s) { v = std::string(s); }
+
+void parse_option_value(std::vector<std::string>& v, std::string_view s)
+{
+  v.clear();
+  for(size_t pos = 0; pos < s.size(); ) {
+    auto end = std::min(s.find(',', pos), s.size());
+    if(end > pos) v.emplace_back(s.substr(pos, end - pos));
+    pos = end + 1;
+  }
+}
+
+std::string option_value_str(bool v) { return v ? "1" : "0"; }
+
+std::string option_value_str(double v)
+{
+  std::ostringstream os;
+  os << v;
+  return os.str();
+}
+
+std::string option_value_str(const std::string& v) { return v; }
+
+std::string option_value_str(const std::optional<std::string>& v) { return v.value_or(""); }
+
+// elements may be lists separated by ';' or ',', while worker splits the value on ',' only
+std::string option_value_str(const std::vector<std::string>& v)
+{
+  std::string r;
+  boost::char_separator<char> sep(";,");
+  for(const auto& e: v) {
+    for(const auto& t: boost::tokenizer<boost::char_separator<char>>(e, sep)) r += (r.empty() ? "" : ",") + t;
+  }
+  return r;
+}
+
+
+void set_option(Options& options, std::string_view name, std::string_view value)
+{
+  bool found {};
+  for_each_dompdf_option([&](std::string_view n, auto member){
+    if(n != name) return;
+    found = true;
+    try {
+      parse_option_value(options.*member, value);
+    }
+    catch(const std::invalid_argument&) {
+      throw std::runtime_error("bad value of option " + std::string(name) + ": " + std::string(value));
+    }
+  });
+  if(!found) throw std::runtime_error("unknown option: " + std::string(name));
+}
+
+
+// function return "name=value\n" lines of Dompdf options, which differ in job from those of worker;
+// options, which are set by worker, but not by job, can't be reset and keep values of worker
+std::string option_overrides(const Options& worker, const Options& job)
+{
+  std::string r;
+  for_each_dompdf_option([&](std::string_view name, auto member){
+    auto w = worker.*member, j = job.*member;
+    // worker caches font metrics in fontDir, unless fontCache is set
+    if constexpr(std::is_same_v<decltype(w), std::optional<std::string>>) {
+      if(name == "fontCache") {
+        if(!w) w = worker.fontDir;
+        if(!j) j = job.fontDir;
+      }
+      if(!j) return;
+    }
+    if(w != j) r += std::string(name) + '=' + option_value_str(j) + '\n';
+  });
+  return r;
+}
+
+
+// function return digest of Dompdf options, of processing of documents and of the runtime, which identifies
+// how documents are converted; it keys output cache and journal of converted documents
+std::string options_digest(const Options& opts)
+{
+  sha256 h;
+  h.update(runtime_key() + '\n');
+  for_each_dompdf_option([&](std::string_view name, auto member){
+    h.update(std::string(name) + '=' + option_value_str(opts.*member) + '\n');
+  });
+  // processing, which changes the produced PDF: documents rewritten to reference optimized images
+  // and downloaded assets, and documents merged from parts
+  if(opts.image_cache) h.update("image-cache image-quality=" + std::to_string(opts.image_quality) + '\n');
+  if(opts.asset_cache) h.update("asset-cache\n");
+  if(opts.split_size) h.update("split-size=" + std::to_string(opts.split_size) + '\n');
+  return h.hexdigest();
+}
+
+
+// converter state is shared by its supervisor threads; each of them owns one php-cli worker
+struct converter::impl {
+  // document is converted by one job, or by jobs of its parts, which are merged when the last of them is done
+  struct document {
+    std::mutex m;
+    std::vector<std::string> parts;   // converted parts
+    size_t remaining {};
+    size_t queued {};                 // parts not yet taken by a worker; guarded by mutex of converter
+    std::string error;
+    std::string cache_key;
+    std::promise<std::vector<std::byte>> result;
+  };
+  struct job {
+    std::string overrides;
+    std::string html;
+    std::shared_ptr<document> doc;
+    size_t part {};
+  };
+
+  Options options;
+  std::vector<std::string> php_args;
+  std::unique_ptr<output_cache> cache;
+  std::atomic<unsigned> stored {};
+  mutable std::mutex m;
+  std::condition_variable cv;
+  std::deque<job> queue;
+  size_t waiting {};      // documents queued or being prepared by convert(), which have parts not taken by a worker
+  bool stopping {};
+  statistics stats;
+  std::vector<std::jthread> supervisors;
+
+  void supervise();
+  void finish(job& j, bool ok, std::string data);
+};
+
+
+// function record result of job; document gets its result, when the last of its parts is done,
+// and is put to output cache
+void converter::impl::finish(job& j, bool ok, std::string data)
+{
+  auto& d = *j.doc;
+  {
+    std::lock_guard lk(d.m);
+    if(ok) d.parts[j.part] = std::move(data);
+    else if(d.error.empty()) d.error = d.parts.size() == 1 ? data : "part " + std::to_string(j.part + 1) + " of "
+                                                                    + std::to_string(d.parts.size()) + ": " + data;
+    if(--d.remaining) return;
+  }
+  if(!d.error.empty()) {
+    d.result.set_exception(std::make_exception_ptr(std::runtime_error(d.error)));
+    return;
+  }
+  std::string pdf;
+  if(d.parts.size() == 1) {
+    pdf = std::move(d.parts.front());
+  } else {
+    try {
+      pdf_merger merger;
+      for(const auto& e: d.parts) merger.append(e);
+      pdf = merger.str();
+    }
+    catch(const std::exception& e) {
+      d.result.set_exception(std::make_exception_ptr(std::runtime_error(std::string("can't merge parts: ") + e.what())));
+      return;
+    }
+  }
+  if(cache) {
+    cache->store(d.cache_key, pdf);
+    // cache is shrunk now and then, as scan of its directory isn't cheap
+    if(++stored % 256 == 0) cache->evict();
+  }
+  auto p = reinterpret_cast<const std::byte*>(pdf.data());
+  d.result.set_value(std::vector<std::byte>(p, p + pdf.size()));
+}
+
+
+#if BOOST_OS_UNIX
+
+// function convert jobs from the queue by php-cli worker, and restart the worker when it crashes,
+// when its resident size exceeds php_memory_limit, or after batch_size jobs
+void converter::impl::supervise()
+{
+  // write to crashed worker fails with EPIPE instead of killing the process; signal disposition
+  // of the application isn't changed
+  sigset_t sigpipe;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+  auto max_worker_jobs = std::max(1u, options.batch_size);
+  // font directory is kept by restarted workers, so fonts of @font-face rules are installed once
+  font_install_dir fonts;
+  auto args = fonts.php_args();
+  args.insert(args.end(), php_args.begin(), php_args.end());
+  php_worker w;
+  for(;;) {
+    job j;
+    {
+      std::unique_lock lk(m);
+      cv.wait(lk, [this]{ return stopping || !queue.empty(); });
+      if(queue.empty()) break;
+      j = std::move(queue.front());
+      queue.pop_front();
+      if(!--j.doc->queued) --waiting;
+      ++stats.busy;
+    }
+    bool ok {};
+    std::string reply, data;
+    try {
+      if(w.pid < 0) w = spawn_php_worker(args);
+      // stderr keeps messages of the current job only; if it can't be truncated, older ones are kept
+      [[maybe_unused]] auto truncated = ftruncate(w.err, 0);
+      std::string header = std::to_string(j.overrides.size()) + ' ' + std::to_string(j.html.size()) + '\n';
+      if( write_all(w.in, header) && write_all(w.in, j.overrides) && write_all(w.in, j.html)
+          && read_reply(w.out, reply, data) ) {
+        ok = reply == "ok";
+        if(++w.jobs_done >= max_worker_jobs || process_rss(w.pid) > options.php_memory_limit) {
+          stop_php_worker(w, false);
+          std::lock_guard lk(m);
+          ++stats.restarts;
+        }
+      } else {
+        data = "php-cli worker crashed";
+        if(auto error = php_worker_error(w); !error.empty()) data += ": " + error;
+        stop_php_worker(w, true);
+        std::lock_guard lk(m);
+        ++stats.restarts;
+      }
+    }
+    catch(const std::exception& e) {
+      data = e.what();
+    }
+    {
+      // statistics are updated first, so they count the job when its result is received
+      std::lock_guard lk(m);
+      --stats.busy;
+      ++(ok ? stats.done : stats.failed);
+    }
+    finish(j, ok, std::move(data));
+  }
+  stop_php_worker(w, false);
+}
+
+
+converter::converter(const Options& options)
+  : impl_(std::make_unique<impl>())
+{
+  extract_embedded_resources(options);
+  impl_->options = options;
+  impl_->options.jobs = std::max(1u, options.jobs);
+  // worker script is passed in command line, so nothing is written to temp directory
+  auto script = php_worker_script(options);
+  script.erase(0, script.find('\n') + 1);  // php-cli -r takes code without opening tag
+  impl_->php_args = php_ini_args(options);
+  // errors PHP reports before the script sets display_errors, e.g. at startup, don't break replies on stdout
+  impl_->php_args.insert(impl_->php_args.end(), { "-d", "display_errors=stderr", "-r", script });
+  if(options.cache_dir) impl_->cache = std::make_unique<output_cache>(fs::absolute(*options.cache_dir), options.cache_size << 20);
+  impl_->stats.workers = impl_->options.jobs;
+  for(unsigned i=0; i<impl_->options.jobs; ++i) impl_->supervisors.emplace_back([this]{ impl_->supervise(); });
+  std::lock_guard lk(runtime_mutex);
+  ++runtime_users;
+}
+
+#else
+
+void converter::impl::supervise()
+{
+}
+
+
+converter::converter(const Options&)
+{
+  throw std::runtime_error("converter is not supported on this platform");
+}
+
+#endif
+
+
+converter::~converter()
+{
+  {
+    std::lock_guard lk(impl_->m);
+    impl_->stopping = true;
+  }
+  impl_->cv.notify_all();
+  impl_->supervisors.clear();
+  if(impl_->cache) impl_->cache->evict();
+  std::lock_guard lk(runtime_mutex);
+  if(!--runtime_users && impl_->options.clean) remove_runtime();
+}
+
+
+std::future<std::vector<std::byte>> converter::convert(std::string_view html)
+{
+  return convert(html, impl_->options);
+}
+
+
+std::future<std::vector<std::byte>> converter::convert(std::string_view html, const Options& options)
+{
+  return std::move(convert(std::vector{html}, options).front());
+}
+
+
+std::vector<std::future<std::vector<std::byte>>> converter::convert(const std::vector<std::string_view>& htmls)
+{
+  return convert(htmls, impl_->options);
+}
+
+
+std::vector<std::future<std::vector<std::byte>>> converter::convert(const std::vector<std::string_view>& htmls,
+                                                                     const Options& options)
+{
+  // job takes Dompdf options only, processing of documents is given by the converter
+  const auto& conv = impl_->options;
+  auto job_options = conv;
+  for_each_dompdf_option([&](std::string_view, auto member){ job_options.*member = options.*member; });
+  // chroot of job replaces that of worker, which includes caches of assets and images
+  if(job_options.chroot != conv.chroot) {
+    for(const auto& dir: { conv.asset_cache, conv.image_cache }) if(dir) job_options.chroot.push_back(fs::absolute(*dir).string());
+  }
+
+  // max_queue counts documents, whatever number of parts they are split to; their place in the queue
+  // is reserved before they are processed, so a rejected call does no work, and it is released
+  // for documents answered from cache, or for all of them, when processing fails
+  {
+    std::lock_guard lk(impl_->m);
+    if(conv.max_queue && impl_->waiting + htmls.size() > conv.max_queue) throw queue_full();
+    impl_->waiting += htmls.size();
+  }
+  std::vector<impl::job> jobs;
+  std::vector<std::future<std::vector<std::byte>>> results;
+  std::vector<std::pair<std::promise<std::vector<std::byte>>, std::string>> cached;
+  try {
+    // documents are rewritten to reference local copies of remote assets and optimized images,
+    // as files are by command line
+    std::vector<std::string> texts(htmls.begin(), htmls.end());
+    if(conv.asset_cache && job_options.isRemoteEnabled && !texts.empty()) {
+      asset_prefetcher prefetcher(fs::absolute(*conv.asset_cache), job_options);
+      auto rewritten = prefetcher.prefetch(texts);
+      for(size_t i=0; i<texts.size(); ++i) if(!rewritten[i].empty()) texts[i] = std::move(rewritten[i]);
+    }
+    if(conv.image_cache && !texts.empty()) {
+      image_optimizer optimizer(fs::absolute(*conv.image_cache), job_options);
+      auto rewritten = optimizer.optimize(texts, conv.jobs);
+      for(size_t i=0; i<texts.size(); ++i) if(!rewritten[i].empty()) texts[i] = std::move(rewritten[i]);
+    }
+
+    // documents found in output cache are answered at once, large ones are split to parts, which are separate jobs;
+    // worker reuses cached font metrics only for jobs without overrides
+    auto overrides = option_overrides(conv, job_options);
+    for(auto& text: texts) {
+      auto d = std::make_shared<impl::document>();
+      if(impl_->cache) {
+        try {
+          d->cache_key = impl_->cache->key(text, temp_path(), job_options);
+        }
+        catch(const std::exception&) {
+          // document, which references unreadable files, isn't cached
+        }
+        if(auto pdf = impl_->cache->fetch(d->cache_key)) {
+          results.push_back(cached.emplace_back(std::promise<std::vector<std::byte>>(), std::move(*pdf)).first.get_future());
+          continue;
+        }
+      }
+      std::vector<std::string> parts;
+      if(conv.split_size && text.size() > conv.split_size) parts = split_html(text, conv.split_size);
+      if(parts.empty()) parts.push_back(std::move(text));
+      d->parts.resize(parts.size());
+      d->remaining = parts.size();
+      d->queued = parts.size();
+      results.push_back(d->result.get_future());
+      for(size_t k=0; k<parts.size(); ++k) jobs.push_back({overrides, std::move(parts[k]), d, k});
+    }
+  }
+  catch(...) {
+    std::lock_guard lk(impl_->m);
+    impl_->waiting -= htmls.size();
+    throw;
+  }
+  {
+    std::lock_guard lk(impl_->m);
+    impl_->waiting -= cached.size();
+    for(auto& e: jobs) impl_->queue.push_back(std::move(e));
+    impl_->stats.cached += cached.size();
+  }
+  impl_->cv.notify_all();
+  for(auto& [result, pdf]: cached) {
+    auto p = reinterpret_cast<const std::byte*>(pdf.data());
+    result.set_value(std::vector<std::byte>(p, p + pdf.size()));
+  }
+  return results;
+}
+
+
+const Options& converter::options() const
+{
+  return impl_->options;
+}
+
+
+converter::statistics converter::stats() const
+{
+  std::lock_guard lk(impl_->m);
+  auto r = impl_->stats;
+  r.queue = impl_->waiting;
+  return r;
+}
+
+} // namespace dompdfui
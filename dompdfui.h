@@ -0,0 +1,126 @@
+#ifndef DOMPDFUI_H
+#define DOMPDFUI_H
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace dompdfui {
+
+// options of conversion; Dompdf options have the names of Dompdf\Options properties,
+// and runtime settings the names of command line options of dompdfui
+struct Options {
+  // Dompdf options
+  bool isPhpEnabled {false};
+  bool isRemoteEnabled {false};
+  bool isPdfAEnabled {false};
+  bool isJavascriptEnabled {true};
+  bool isHtml5ParserEnabled {true};
+  bool isFontSubsettingEnabled {true};
+  bool sslAllowSelfSigned {true};
+  bool debugPng {false};
+  bool debugKeepTemp {false};
+  bool debugCss {false};
+  bool debugLayout {false};
+  bool debugLayoutLines {true};
+  bool debugLayoutBlocks {true};
+  bool debugLayoutInline {true};
+  bool debugLayoutPaddingBox {true};
+  double dpi {96};
+  double fontHeightRatio {1.1};
+  std::optional<std::string> rootDir;
+  std::optional<std::string> tempDir;
+  std::optional<std::string> fontDir;
+  std::optional<std::string> fontCache;       // fontDir, if it is not set
+  std::optional<std::string> logOutputFile;
+  std::string defaultMediaType {"screen"};
+  std::string defaultPaperSize {"a4"};
+  std::string defaultPaperOrientation {"portrait"};
+  std::string defaultFont {"dejavu serif"};
+  std::string pdfBackend {"CPDF"};
+  std::optional<std::string> pdflibLicense;
+  std::vector<std::string> chroot;             // elements may be lists separated by ';' or ','
+  std::vector<std::string> allowedRemoteHosts;
+
+  // runtime settings; they are taken by converter from its own options, and ignored in options of a job
+  unsigned jobs {std::max(1u, std::thread::hardware_concurrency())};  // number of php-cli workers
+  unsigned batch_size {20};                     // jobs converted by a worker before it is restarted
+  unsigned max_queue {0};                       // maximum number of waiting documents, split ones included once; 0 is unlimited
+  unsigned long long php_memory_limit {268435456};  // bytes; a worker is restarted when it grows larger
+  bool opcache {false};
+  bool php_in_memory {false};
+  bool no_zip_copy {false};
+  bool clean {false};                           // remove runtime directory, when the last converter is destroyed
+
+  // processing of documents before and after conversion; like runtime settings, they are taken by converter
+  // from its own options. Directories are created, when they don't exist
+  std::optional<std::string> cache_dir;         // cache of converted documents, keyed by content, local assets and options
+  unsigned long long cache_size {1024};         // megabytes; least recently used documents are evicted
+  std::optional<std::string> asset_cache;       // remote assets are downloaded there before conversion; requires isRemoteEnabled
+  unsigned asset_connections {16};              // maximum number of concurrent downloads
+  std::optional<std::string> image_cache;       // images are downscaled to their size in document and recompressed there
+  unsigned image_quality {85};                  // quality of optimized JPEG images, 1-100
+  unsigned long long split_size {0};            // bytes; larger documents are converted in parts, which are merged; 0 disables
+};
+
+
+// function set Dompdf option with given name from its string form, as it is given in command line;
+// lists are separated by ','. Throws std::runtime_error on unknown name or bad value
+void set_option(Options& options, std::string_view name, std::string_view value);
+
+
+// thrown by converter, when max_queue documents wait for workers
+class queue_full : public std::runtime_error {
+public:
+  queue_full() : std::runtime_error("queue of converter is full") {}
+};
+
+
+// converter of HTML documents to PDF in memory; it extracts the runtime once and keeps a pool
+// of warm php-cli workers, which start with the first jobs and live until converter is destroyed.
+// Documents are processed according to cache_dir, asset_cache, image_cache and split_size of the converter
+// when they are queued; relative references in them are resolved against the runtime directory.
+// Results of failed conversions throw std::runtime_error from future::get(), with the message of PHP
+// exception, or the last line of stderr of a worker killed by a fatal error.
+// Pending jobs are converted before destructor returns. Supported on Unix only
+class converter {
+public:
+  struct statistics {
+    size_t queue {};       // documents waiting for a worker
+    unsigned busy {};      // jobs being converted
+    unsigned workers {};
+    unsigned long long done {}, failed {}, restarts {};
+    unsigned long long cached {};   // jobs answered from cache_dir, without conversion
+  };
+
+  explicit converter(const Options& options = {});
+  ~converter();
+  converter(const converter&) = delete;
+  converter& operator=(const converter&) = delete;
+
+  // function queue conversion of document with Dompdf options of the converter, or given ones
+  std::future<std::vector<std::byte>> convert(std::string_view html);
+  std::future<std::vector<std::byte>> convert(std::string_view html, const Options& options);
+
+  // function queue conversion of several documents; either all of them are queued or none
+  std::vector<std::future<std::vector<std::byte>>> convert(const std::vector<std::string_view>& htmls);
+  std::vector<std::future<std::vector<std::byte>>> convert(const std::vector<std::string_view>& htmls, const Options& options);
+
+  const Options& options() const;
+  statistics stats() const;
+
+private:
+  struct impl;
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dompdfui
+
+#endif // DOMPDFUI_H
@@ -0,0 +1,300 @@
+# Generate synthetic HTML corpus, convert it by dompdfui with several settings, and compare results with baseline.
+# Variables: DOMPDFUI - path to executable, WORK_DIR - directory for corpus and results,
+#            BASELINE - results of previous run to compare with, UPDATE_BASELINE - replace baseline by results
+
+cmake_host_system_information(RESULT CORES QUERY NUMBER_OF_LOGICAL_CORES)
+set(CORPUS_DIR "${WORK_DIR}/corpus")
+set(CORPUS_VERSION 1)
+
+# 16x16 PNG image for data URIs
+set(PNG_BASE64 "iVBORw0KGgoAAAANSUhEUgAAABAAAAAQCAIAAACQkWg2AAABlklEQVR42hXRURVEIQhFUSMYgQhGMAIRiGCEE8EIRiACEYhABCLMG7/ZrMt1jMEcyGAN9kAHNjgDBnfwBj6IQQ5q0IMxJnMikzXZE53Y5EyY3Mmb+CQmOalJzw8IUxBhCVtQwYQjIFzhCS6EkEIJLR9YzIUs1mIvdGGLs2BxF2/hi1jkoha9PrCZG9mszd7oxjZnw+Zu3sY3sclNbXp/QJmKKEvZiiqmHAXlKk9xJZRUSmn9gDENMZaxDTXMOAbGNZ7hRhhplNH2gcM8yGEd9kEPdjgHDvfwDn6IQx7q0OcD/wK/Sr4jv9hfkG/1N/x/Fx44BCQU9Pc94zIvclmXfdGLXc79j9/Lu/glLnmpS98PPOZDHuuxH/qwx3n/5ffxHv6IRz7q0e8DznTEWc521DHn+D/KdZ7jTjjplNP+gWAGEqxgBxpYcOIf/AYv8CCCDCro+EAyE0lWshNNLDn5P/MmL/Ekkkwq6fxAMQspVrELLaw49S/lFq/wIoosquj6QDMbaVazG22sOf2v8Dav8SaabKrp5geIAnAQC3NfwAAAAABJRU5ErkJggg==")
+set(TEXT "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.")
+
+# function write document to corpus, or to directory given as the third argument
+function(write_document NAME BODY)
+  set(DIR "${CORPUS_DIR}")
+  if(ARGC GREATER 2)
+    set(DIR "${ARGV2}")
+  endif()
+  file(WRITE "${DIR}/${NAME}.html"
+    "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><style>\n"
+    "table { border-collapse: collapse; } td, th { border: 1px solid #888; padding: 2px; }\n"
+    ".box { border: 1px solid #444; margin: 2px; padding: 2px; } .page { page-break-after: always; }\n"
+    "</style></head><body>\n${BODY}</body></html>\n")
+endfunction()
+
+# corpus is generated deterministically, and only once for each version of this script
+if(NOT EXISTS "${CORPUS_DIR}/version_${CORPUS_VERSION}")
+  file(REMOVE_RECURSE "${CORPUS_DIR}")
+  file(MAKE_DIRECTORY "${CORPUS_DIR}")
+  # plain text of different size
+  foreach(PARAGRAPHS 1 10 100 400)
+    set(BODY "")
+    foreach(I RANGE 1 ${PARAGRAPHS})
+      string(APPEND BODY "<h3>Section ${I}</h3><p>${TEXT} ${TEXT}</p>\n")
+    endforeach()
+    write_document("text_${PARAGRAPHS}" "${BODY}")
+  endforeach()
+  # large tables
+  foreach(ROWS 100 1000 3000)
+    set(BODY "<table><thead><tr><th>#</th><th>Name</th><th>Amount</th><th>Comment</th></tr></thead><tbody>\n")
+    foreach(I RANGE 1 ${ROWS})
+      math(EXPR AMOUNT "(${I} * 7919) % 100000")
+      string(APPEND BODY "<tr><td>${I}</td><td>Item ${I}</td><td align=\"right\">${AMOUNT}.00</td><td>${TEXT}</td></tr>\n")
+    endforeach()
+    write_document("table_${ROWS}" "${BODY}</tbody></table>\n")
+  endforeach()
+  # nested layouts
+  foreach(DEPTH 10 40)
+    set(BODY "${TEXT}")
+    foreach(I RANGE 1 ${DEPTH})
+      math(EXPR MOD "${I} % 3")
+      if(MOD EQUAL 0)
+        set(BODY "<table><tr><td>${I}</td><td>${BODY}</td></tr></table>")
+      elseif(MOD EQUAL 1)
+        set(BODY "<div class=\"box\" style=\"float: left; width: 95%\">${BODY}</div>")
+      else()
+        set(BODY "<ul><li>${I}<ul><li>${BODY}</li></ul></li></ul>")
+      endif()
+    endforeach()
+    write_document("nested_${DEPTH}" "${BODY}\n")
+  endforeach()
+  # many pages
+  foreach(PAGES 20 200)
+    set(BODY "")
+    foreach(I RANGE 1 ${PAGES})
+      string(APPEND BODY "<div class=\"page\"><h1>Page ${I}</h1><p>${TEXT}</p></div>\n")
+    endforeach()
+    write_document("pages_${PAGES}" "${BODY}")
+  endforeach()
+  # data URI images
+  foreach(IMAGES 10 200)
+    set(BODY "")
+    foreach(I RANGE 1 ${IMAGES})
+      string(APPEND BODY "<img src=\"data:image/png;base64,${PNG_BASE64}\" width=\"48\" height=\"48\">\n")
+    endforeach()
+    write_document("images_${IMAGES}" "${BODY}")
+  endforeach()
+  file(WRITE "${CORPUS_DIR}/version_${CORPUS_VERSION}" "")
+endif()
+file(GLOB CORPUS "${CORPUS_DIR}/*.html")
+list(SORT CORPUS)
+list(LENGTH CORPUS DOCUMENTS)
+
+# one huge table, converted whole and split to parts by --split-size; it is kept apart from the corpus
+set(LARGE_TABLE "${WORK_DIR}/large/table_20000.html")
+if(NOT EXISTS "${LARGE_TABLE}")
+  set(BODY "<table><thead><tr><th>#</th><th>Name</th><th>Amount</th><th>Comment</th></tr></thead><tbody>\n")
+  foreach(I RANGE 1 20000)
+    math(EXPR AMOUNT "(${I} * 7919) % 100000")
+    string(APPEND BODY "<tr><td>${I}</td><td>Item ${I}</td><td align=\"right\">${AMOUNT}.00</td><td>${TEXT}</td></tr>\n")
+  endforeach()
+  write_document("table_20000" "${BODY}</tbody></table>\n" "${WORK_DIR}/large")
+endif()
+
+# function convert "12.345678" to integer number of microseconds
+function(to_us VALUE OUT)
+  string(REGEX MATCH "^([0-9]+)\\.?([0-9]*)" _ "${VALUE}")
+  set(INTEGER "${CMAKE_MATCH_1}")
+  set(FRACTION "${CMAKE_MATCH_2}000000")
+  string(SUBSTRING "${FRACTION}" 0 6 FRACTION)
+  string(REGEX REPLACE "^0+([0-9])" "\\1" FRACTION "${FRACTION}")
+  math(EXPR US "${INTEGER} * 1000000 + ${FRACTION}")
+  set(${OUT} ${US} PARENT_SCOPE)
+endfunction()
+
+# function return given percentile of sorted list
+function(percentile LIST P OUT)
+  list(LENGTH LIST N)
+  math(EXPR INDEX "(${N} * ${P} + 99) / 100 - 1")
+  if(INDEX LESS 0)
+    set(INDEX 0)
+  endif()
+  list(GET LIST ${INDEX} VALUE)
+  set(${OUT} ${VALUE} PARENT_SCOPE)
+endfunction()
+
+# macro run COMMAND; output of program is written to STREAM_OUTPUT, if it is set
+macro(run_dompdfui)
+  if(STREAM_OUTPUT)
+    execute_process(COMMAND ${COMMAND} RESULT_VARIABLE RESULT OUTPUT_FILE "${STREAM_OUTPUT}" ERROR_VARIABLE OUTPUT)
+  else()
+    execute_process(COMMAND ${COMMAND} RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+  endif()
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NAME}: dompdfui failed\n${OUTPUT}")
+  endif()
+endmacro()
+
+# scenarios: name, temp directory and comma separated options; 'cold' runs start with empty temp directory,
+# the others reuse it. Scenarios with --stream-framing convert the corpus to standard output by a pool
+# of warm workers, instead of a process started for each batch
+set(SCENARIOS
+  "cold_serial|cold|--jobs,1,--batch-size,1"
+  "warm_serial|warm|--jobs,1,--batch-size,1"
+  "worker_serial|warm|--jobs,1,--stream-framing,length"
+  "warm_serial_opcache|warm|--jobs,1,--batch-size,1,--opcache"
+  "warm_parallel|warm|--jobs,${CORES},--batch-size,1"
+  "warm_parallel_batch|warm|--jobs,${CORES},--batch-size,20"
+  "warm_parallel_batch_opcache|warm|--jobs,${CORES},--batch-size,20,--opcache"
+  "output_cache_hit|warm|--jobs,${CORES},--cache-dir,${WORK_DIR}/output_cache"
+  "large_table_whole|warm|--jobs,${CORES},--php-memory-limit,4294967296"
+  "large_table_split|warm|--jobs,${CORES},--php-memory-limit,4294967296,--split-size,262144"
+)
+file(REMOVE_RECURSE "${WORK_DIR}/tmp_warm" "${WORK_DIR}/output_cache")
+set(RESULTS "{}")
+string(JSON RESULTS SET "${RESULTS}" "documents" "${DOCUMENTS}")
+string(JSON RESULTS SET "${RESULTS}" "cores" "${CORES}")
+foreach(SCENARIO ${SCENARIOS})
+  string(REPLACE "|" ";" FIELDS "${SCENARIO}")
+  list(GET FIELDS 0 NAME)
+  list(GET FIELDS 1 TEMP)
+  list(GET FIELDS 2 OPTIONS)
+  string(REPLACE "," ";" OPTIONS "${OPTIONS}")
+  set(INPUTS ${CORPUS})
+  set(COUNT ${DOCUMENTS})
+  if(NAME MATCHES "^large_table")
+    set(INPUTS "${LARGE_TABLE}")
+    set(COUNT 1)
+  endif()
+  set(TEMP_DIR "${WORK_DIR}/tmp_${TEMP}")
+  if(TEMP STREQUAL "cold")
+    file(REMOVE_RECURSE "${TEMP_DIR}")
+  endif()
+  file(MAKE_DIRECTORY "${TEMP_DIR}")
+  set(OUT_DIR "${WORK_DIR}/out/${NAME}")
+  set(REPORT "${WORK_DIR}/reports/${NAME}.jsonl")
+  file(REMOVE "${REPORT}")
+  file(MAKE_DIRECTORY "${OUT_DIR}" "${WORK_DIR}/reports")
+  set(COMMAND ${CMAKE_COMMAND} -E env TMPDIR=${TEMP_DIR} TMP=${TEMP_DIR} TEMP=${TEMP_DIR}
+      "${DOMPDFUI}" --force-out --no-clean --report "${REPORT}" ${OPTIONS} ${INPUTS} "${OUT_DIR}")
+  set(STREAM_OUTPUT "")
+  string(FIND ";${OPTIONS};" ";--stream-framing;" STREAM)
+  if(STREAM GREATER_EQUAL 0)
+    # results are framed on standard output, and there is no report
+    set(STREAM_OUTPUT "${OUT_DIR}/stream.out")
+    set(COMMAND ${CMAKE_COMMAND} -E env TMPDIR=${TEMP_DIR} TMP=${TEMP_DIR} TEMP=${TEMP_DIR}
+        "${DOMPDFUI}" --no-clean ${OPTIONS} ${INPUTS} -)
+  endif()
+  if(NAME STREQUAL "output_cache_hit")
+    # the first run fills the cache
+    run_dompdfui()
+    file(REMOVE "${REPORT}")
+  endif()
+  string(TIMESTAMP T0 "%s%f")
+  run_dompdfui()
+  string(TIMESTAMP T1 "%s%f")
+  math(EXPR WALL_US "${T1} - ${T0}")
+  math(EXPR WALL_MS "${WALL_US} / 1000")
+  # throughput is in documents per minute, to keep it integer
+  math(EXPR THROUGHPUT "${COUNT} * 60000000 / ${WALL_US}")
+
+  # latency of document is its render time measured inside php-cli, or wall time of php-cli process
+  # which converted it alone, including startup; documents copied from output cache have none
+  set(LINES "")
+  if(EXISTS "${REPORT}")
+    file(STRINGS "${REPORT}" LINES)
+  endif()
+  set(LATENCIES "")
+  set(PROCESS_LATENCIES "")
+  set(MAX_RSS 0)
+  foreach(LINE ${LINES})
+    string(JSON TYPE GET "${LINE}" "type")
+    if(TYPE STREQUAL "run")
+      string(JSON MAX_RSS GET "${LINE}" "max_rss_kb")
+    else()
+      string(JSON RENDER GET "${LINE}" "render_s")
+      if(NOT RENDER MATCHES "^[0-9]")
+        string(JSON RENDER ERROR_VARIABLE ERR GET "${LINE}" "process" "wall_s")
+      endif()
+      if(RENDER MATCHES "^[0-9]")
+        to_us("${RENDER}" RENDER_US)
+        list(APPEND LATENCIES ${RENDER_US})
+      endif()
+      # with --batch-size 1 wall time of php-cli process is latency of its document, including startup
+      # and compilation of Dompdf sources, which render time doesn't include
+      string(JSON PROCESS_WALL ERROR_VARIABLE ERR GET "${LINE}" "process" "wall_s")
+      if(NOT ERR AND PROCESS_WALL MATCHES "^[0-9]")
+        to_us("${PROCESS_WALL}" PROCESS_US)
+        list(APPEND PROCESS_LATENCIES ${PROCESS_US})
+      endif()
+    endif()
+  endforeach()
+  set(ENTRY "{}")
+  string(JSON ENTRY SET "${ENTRY}" "wall_ms" "${WALL_MS}")
+  string(JSON ENTRY SET "${ENTRY}" "documents_per_min" "${THROUGHPUT}")
+  string(JSON ENTRY SET "${ENTRY}" "max_rss_kb" "${MAX_RSS}")
+  set(SUMMARY "wall ${WALL_MS} ms, ${THROUGHPUT} documents/min, peak RSS ${MAX_RSS} KB")
+  if(LATENCIES)
+    list(SORT LATENCIES COMPARE NATURAL)
+    foreach(P 50 90 99)
+      percentile("${LATENCIES}" ${P} VALUE)
+      math(EXPR VALUE "${VALUE} / 1000")
+      string(JSON ENTRY SET "${ENTRY}" "p${P}_ms" "${VALUE}")
+      string(APPEND SUMMARY ", p${P} ${VALUE} ms")
+    endforeach()
+  endif()
+  string(FIND ";${OPTIONS};" ";--batch-size;1;" SINGLE)
+  if(PROCESS_LATENCIES AND SINGLE GREATER_EQUAL 0)
+    list(SORT PROCESS_LATENCIES COMPARE NATURAL)
+    percentile("${PROCESS_LATENCIES}" 50 VALUE)
+    math(EXPR VALUE "${VALUE} / 1000")
+    string(JSON ENTRY SET "${ENTRY}" "process_p50_ms" "${VALUE}")
+    string(APPEND SUMMARY ", process p50 ${VALUE} ms")
+  endif()
+  string(JSON RESULTS SET "${RESULTS}" "${NAME}" "${ENTRY}")
+  message(STATUS "${NAME}: ${SUMMARY}")
+endforeach()
+# effect of --opcache on per-document latency, which includes compilation of Dompdf sources
+string(JSON PLAIN ERROR_VARIABLE ERR GET "${RESULTS}" "warm_serial" "process_p50_ms")
+string(JSON OPCACHE ERROR_VARIABLE ERR2 GET "${RESULTS}" "warm_serial_opcache" "process_p50_ms")
+if(NOT ERR AND NOT ERR2 AND PLAIN GREATER 0)
+  math(EXPR PERCENT "(${OPCACHE} - ${PLAIN}) * 100 / ${PLAIN}")
+  message(STATUS "opcache: per-document latency p50 ${PLAIN} ms -> ${OPCACHE} ms (${PERCENT}%)")
+endif()
+# pool of warm workers vs a process started for each document, both converting one document at a time
+string(JSON SPAWNED ERROR_VARIABLE ERR GET "${RESULTS}" "warm_serial" "wall_ms")
+string(JSON POOLED ERROR_VARIABLE ERR2 GET "${RESULTS}" "worker_serial" "wall_ms")
+if(NOT ERR AND NOT ERR2 AND SPAWNED GREATER 0)
+  math(EXPR PERCENT "(${POOLED} - ${SPAWNED}) * 100 / ${SPAWNED}")
+  message(STATUS "workers: wall time of corpus ${SPAWNED} ms with process per document -> ${POOLED} ms (${PERCENT}%)")
+endif()
+file(WRITE "${WORK_DIR}/results.json" "${RESULTS}\n")
+message(STATUS "Results are saved to ${WORK_DIR}/results.json")
+
+# differences with baseline, in percent
+if(EXISTS "${BASELINE}")
+  file(READ "${BASELINE}" BASE)
+  string(JSON COUNT LENGTH "${RESULTS}")
+  math(EXPR LAST "${COUNT} - 1")
+  foreach(I RANGE ${LAST})
+    string(JSON NAME MEMBER "${RESULTS}" ${I})
+    string(JSON TYPE TYPE "${RESULTS}" "${NAME}")
+    string(JSON BASE_ENTRY ERROR_VARIABLE ERR GET "${BASE}" "${NAME}")
+    if(NOT TYPE STREQUAL "OBJECT" OR ERR)
+      continue()
+    endif()
+    string(JSON ENTRY GET "${RESULTS}" "${NAME}")
+    string(JSON METRICS LENGTH "${ENTRY}")
+    math(EXPR LAST_METRIC "${METRICS} - 1")
+    set(DIFF "")
+    foreach(J RANGE ${LAST_METRIC})
+      string(JSON KEY MEMBER "${ENTRY}" ${J})
+      string(JSON VALUE GET "${ENTRY}" "${KEY}")
+      string(JSON BASE_VALUE ERROR_VARIABLE ERR GET "${BASE_ENTRY}" "${KEY}")
+      if(ERR OR BASE_VALUE EQUAL 0)
+        continue()
+      endif()
+      math(EXPR PERCENT "(${VALUE} - ${BASE_VALUE}) * 100 / ${BASE_VALUE}")
+      if(PERCENT GREATER_EQUAL 0)
+        set(PERCENT "+${PERCENT}")
+      endif()
+      string(APPEND DIFF " ${KEY} ${BASE_VALUE} -> ${VALUE} (${PERCENT}%)")
+    endforeach()
+    message(STATUS "${NAME} vs baseline:${DIFF}")
+  endforeach()
+endif()
+if(UPDATE_BASELINE OR NOT EXISTS "${BASELINE}")
+  file(COPY_FILE "${WORK_DIR}/results.json" "${BASELINE}")
+  message(STATUS "Baseline is saved to ${BASELINE}")
+endif()
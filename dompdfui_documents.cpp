@@ -0,0 +1,1098 @@
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <map>
+#include <set>
+#include <random>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+#include <tuple>
+#include <boost/nowide/fstream.hpp>
+#include <boost/tokenizer.hpp>
+#include <boost/predef.h>
+#if BOOST_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+#include "sha256.h"
+#include "http_client.h"
+#include "dompdfui_internal.h"
+
+namespace dompdfui {
+
+namespace fs = std::filesystem ;
+namespace nw = boost::nowide;
+
+
+// function return spans of references to external resources found in HTML or CSS text:
+// values of src and href attributes, url() and @import, ordered by position
+std::vector<reference_span> reference_spans(std::string_view text)
+{
+  std::string lower(text);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+  std::vector<reference_span> spans;
+  for(std::string_view token: {"src=", "href=", "url(", "@import"}) {
+    for(auto pos = lower.find(token); pos != lower.npos; pos = lower.find(token, pos + 1)) {
+      auto begin = lower.find_first_not_of(" \t\r\n", pos + token.size());
+      if(begin == lower.npos) break;
+      size_t end;
+      bool quoted = text[begin] == '"' || text[begin] == '\'';
+      if(quoted) {
+        auto quote = text[begin++];
+        end = lower.find(quote, begin);
+      } else {
+        end = lower.find_first_of(" \t\r\n>);\"'", begin);
+      }
+      if(end == lower.npos) end = lower.size();
+      // value of "@import url(...)" is found by "url(" token
+      if(token == "@import" && !quoted && lower.compare(begin, 4, "url(") == 0) continue;
+      spans.push_back({token, begin, end - begin, quoted});
+    }
+  }
+  std::sort(spans.begin(), spans.end(), [](const auto& a, const auto& b){ return a.pos < b.pos; });
+  return spans;
+}
+
+
+// function return references to external resources found in HTML or CSS text:
+// values of src and href attributes, url() and @import
+std::vector<std::string> resource_references(std::string_view text)
+{
+  std::vector<std::string> refs;
+  for(const auto& e: reference_spans(text)) refs.emplace_back(text.substr(e.pos, e.size));
+  return refs;
+}
+
+
+// function return content of file
+std::string read_file(const fs::path& path)
+{
+  nw::ifstream is ( path, std::ios::binary );
+  if(!is.is_open()) throw std::runtime_error("Can't open file: " + path.string()) ;
+  return { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+}
+
+
+// function copy file, sharing its data blocks with the copy if file system supports it
+void clone_file(const fs::path& from, const fs::path& to)
+{
+#if BOOST_OS_LINUX && defined(FICLONE)
+  int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if(in >= 0) {
+    int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    bool cloned = out >= 0 && !::ioctl(out, FICLONE, in);
+    if(out >= 0) ::close(out);
+    ::close(in);
+    if(cloned) return;
+  }
+#endif
+  fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+}
+
+
+// function write file atomically, so that concurrent instances may share cache directory
+void write_file_atomic(const fs::path& path, std::string_view content)
+{
+  fs::create_directories(path.parent_path());
+  auto tmp_path = fs::path(path).concat("." + std::to_string(std::random_device()()) + ".tmp");
+  nw::ofstream os ( tmp_path, std::ios::binary );
+  if(!os.is_open()) throw std::runtime_error("Can't open file: " + tmp_path.string()) ;
+  os.write(content.data(), content.size());
+  os.close();
+  if(!os) throw std::runtime_error("Can't write to file: " + tmp_path.string()) ;
+  fs::rename(tmp_path, path);
+}
+
+
+output_cache::output_cache(const fs::path& dir, uintmax_t max_size)
+  : dir_(dir), max_size_(max_size)
+{
+  fs::create_directories(dir_);
+}
+
+
+std::string output_cache::key(std::string_view html, const fs::path& base_dir, const Options& options) const
+{
+  sha256 h;
+  h.update("dompdfui output cache 3\n" + options_digest(options));
+  std::set<fs::path> visited;
+  if(!add_file(h, base_dir / "", html, true, options.isRemoteEnabled, visited)) return {};
+  return h.hexdigest();
+}
+
+
+bool output_cache::fetch_file(const std::string& key, const fs::path& out)
+{
+  auto path = entry(key);
+  std::error_code ec;
+  if(key.empty() || !fs::is_regular_file(path, ec)) {
+    ++misses;
+    return false;
+  }
+  try {
+    clone_file(path, out);
+  }
+  catch(const fs::filesystem_error&) {
+    ++misses;
+    return false;
+  }
+  // modification time of entry is its last use
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  ++hits;
+  return true;
+}
+
+
+std::optional<std::string> output_cache::fetch(const std::string& key)
+{
+  auto path = entry(key);
+  std::error_code ec;
+  if(key.empty() || !fs::is_regular_file(path, ec)) {
+    ++misses;
+    return {};
+  }
+  std::string pdf;
+  try {
+    pdf = read_file(path);
+  }
+  catch(const std::runtime_error&) {
+    ++misses;
+    return {};
+  }
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  ++hits;
+  return pdf;
+}
+
+
+void output_cache::store_file(const std::string& key, const fs::path& out)
+{
+  if(key.empty()) return;
+  auto path = entry(key);
+  auto tmp_path = fs::path(path).concat("." + std::to_string(std::random_device()()) + ".tmp");
+  std::error_code ec;
+  try {
+    fs::create_directories(path.parent_path());
+    clone_file(out, tmp_path);
+    fs::rename(tmp_path, path);
+  }
+  catch(const fs::filesystem_error&) {
+    fs::remove(tmp_path, ec);
+  }
+}
+
+
+void output_cache::store(const std::string& key, std::string_view pdf)
+{
+  if(key.empty()) return;
+  try {
+    write_file_atomic(entry(key), pdf);
+  }
+  catch(const std::exception&) {
+    // document isn't cached, if cache directory can't be written
+  }
+}
+
+
+size_t output_cache::evict()
+{
+  std::vector<std::tuple<fs::file_time_type, uintmax_t, fs::path>> entries;
+  uintmax_t total {};
+  std::error_code ec;
+  for(auto it = fs::recursive_directory_iterator(dir_, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if(!it->is_regular_file(ec) || it->path().extension() != ".pdf") continue;
+    auto size = it->file_size(ec);
+    if(ec) continue;
+    entries.emplace_back(it->last_write_time(ec), size, it->path());
+    total += size;
+  }
+  if(total <= max_size_) return 0;
+  std::sort(entries.begin(), entries.end());
+  size_t evicted {};
+  for(const auto& [time, size, path]: entries) {
+    if(total <= max_size_) break;
+    if(fs::remove(path, ec)) {
+      total -= size;
+      ++evicted;
+    }
+  }
+  return evicted;
+}
+
+
+fs::path output_cache::entry(const std::string& key) const
+{
+  return dir_ / key.substr(0, 2) / (key + ".pdf");
+}
+
+
+// function add content of file to hash, with local files it references; style sheets are scanned recursively
+bool output_cache::add_file(sha256& h, const fs::path& file, std::string_view content, bool scan,
+                            bool remote_enabled, std::set<fs::path>& visited) const
+{
+  h.update(std::to_string(content.size()) + '\n').update(content);
+  if(!scan) return true;
+  for(auto ref: resource_references(content)) {
+    if(ref.empty() || ref.front() == '#' || ref.starts_with("data:")) continue;
+    if(ref.starts_with("//") || ref.find("://") != ref.npos) {
+      if(!ref.starts_with("file://")) {
+        // remote resources may change at any time
+        if(remote_enabled) return false;
+        continue;
+      }
+      ref.erase(0, 7);
+    }
+    ref = ref.substr(0, ref.find_first_of("?#"));
+    auto path = (file.parent_path() / fs::path(ref)).lexically_normal();
+    if(!visited.insert(path).second) continue;
+    std::error_code ec;
+    h.update("\n" + ref + '\n');
+    if(!fs::is_regular_file(path, ec)) continue;
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+    if(!add_file(h, path, read_file(path), ext == ".css", remote_enabled, visited)) return false;
+  }
+  return true;
+}
+
+
+memory_model::memory_model(const fs::path& state_path, unsigned long long default_limit, unsigned long long max_limit)
+  : state_path_(state_path), default_limit_(default_limit), max_limit_(max_limit)
+{
+  nw::ifstream is ( state_path_ );
+  std::string line;
+  if(!std::getline(is, line) || line != header) return;
+  while(std::getline(is, line)) {
+    std::istringstream ls(line);
+    entry e;
+    std::string path;
+    if(ls >> e.peak >> e.size >> e.time && std::getline(ls >> std::ws, path)) entries_[path] = e;
+  }
+  // memory per input byte is the 90th percentile of known files, so that a few odd ones don't skew it
+  std::vector<double> ratios;
+  for(const auto& [path, e]: entries_) {
+    if(e.size) ratios.push_back(double(e.peak > base_memory ? e.peak - base_memory : 0) / e.size);
+  }
+  if(!ratios.empty()) {
+    auto nth = ratios.begin() + ratios.size() * 9 / 10;
+    std::nth_element(ratios.begin(), nth, ratios.end());
+    bytes_per_input_byte_ = *nth;
+  }
+}
+
+
+unsigned long long memory_model::limit(const fs::path& file, uintmax_t size) const
+{
+  double estimate;
+  auto it = entries_.find(file.string());
+  if(it != entries_.end()) {
+    const auto& e = it->second;
+    estimate = e.peak <= base_memory || !e.size ? e.peak : base_memory + double(e.peak - base_memory) * size / e.size;
+  } else if(bytes_per_input_byte_ >= 0) {
+    estimate = base_memory + bytes_per_input_byte_ * size;
+  } else {
+    return std::min(default_limit_, max_limit_);
+  }
+  // headroom of a half, rounded up to 16 MiB
+  auto limit = (static_cast<unsigned long long>(estimate * 1.5) | ((16ull << 20) - 1)) + 1;
+  return std::min(std::max(limit, min_limit), max_limit_);
+}
+
+
+void memory_model::record(const fs::path& file, uintmax_t size, unsigned long long peak)
+{
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  std::lock_guard lk(mutex_);
+  entries_[file.string()] = {peak, size, now};
+}
+
+
+void memory_model::save() const
+{
+  std::vector<std::pair<const std::string*, const entry*>> recent;
+  for(const auto& [path, e]: entries_) recent.emplace_back(&path, &e);
+  std::sort(recent.begin(), recent.end(), [](const auto& a, const auto& b){ return a.second->time > b.second->time; });
+  if(recent.size() > max_entries) recent.resize(max_entries);
+  auto tmp_path = fs::path(state_path_).concat("." + std::to_string(std::random_device()()) + ".tmp");
+  std::error_code ec;
+  nw::ofstream os ( tmp_path );
+  os << header << '\n';
+  for(const auto& [path, e]: recent) os << e->peak << ' ' << e->size << ' ' << e->time << ' ' << *path << '\n';
+  os.close();
+  if(os) fs::rename(tmp_path, state_path_, ec);
+  if(!os || ec) fs::remove(tmp_path, ec);
+}
+
+
+asset_prefetcher::asset_prefetcher(const fs::path& dir, const Options& options)
+  : dir_(dir), connections_(std::max(1u, options.asset_connections)),
+    client_(std::make_unique<http_client>(!options.sslAllowSelfSigned))
+{
+  fs::create_directories(dir_);
+  for(const auto& e: options.allowedRemoteHosts) {
+    boost::tokenizer<boost::char_separator<char>> hosts(e, boost::char_separator<char>(",; "));
+    for(auto host: hosts) {
+      std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c){ return std::tolower(c); });
+      allowed_hosts_.insert(host);
+    }
+  }
+  // redirects are checked as well, so that an allowed host can't lead the download elsewhere
+  if(!allowed_hosts_.empty()) client_->allow_hosts([this](const std::string& host){ return allowed(host); });
+}
+
+
+asset_prefetcher::~asset_prefetcher() = default;
+
+
+std::vector<std::string> asset_prefetcher::prefetch(const std::vector<std::string>& docs)
+{
+  for(const auto& doc: docs) {
+    for(const auto& [url, css]: remote_references(doc, {})) request(url, css);
+  }
+  // style sheets may reference further style sheets and assets
+  for(int depth=0; depth<4 && !pending_.empty(); ++depth) {
+    auto wave = std::move(pending_);
+    pending_.clear();
+    for(const auto& url: wave) start(url);
+    client_->run(connections_);
+    for(const auto& url: wave) {
+      const auto& a = assets_[url];
+      if(!a.ok || !a.css) continue;
+      nw::ifstream is ( data_path(url), std::ios::binary );
+      std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+      for(const auto& [ref, css]: remote_references(content, a.meta.url)) request(ref, css);
+    }
+  }
+  for(const auto& [url, a]: assets_) {
+    if(!a.ok || !a.css) continue;
+    nw::ifstream is ( data_path(url), std::ios::binary );
+    std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+    write_file_atomic(local_path(url), rewrite(content, a.meta.url));
+  }
+
+  std::vector<std::string> rewritten(docs.size());
+  for(size_t i=0; i<docs.size(); ++i) {
+    auto content = rewrite(docs[i], {});
+    if(content != docs[i]) rewritten[i] = std::move(content);
+  }
+  return rewritten;
+}
+
+
+fs::path asset_prefetcher::data_path(const std::string& url) const
+{
+  auto key = sha256().update(url).hexdigest();
+  return dir_ / key.substr(0, 2) / key;
+}
+
+
+fs::path asset_prefetcher::local_path(const std::string& url) const
+{
+  auto path = data_path(url);
+  return assets_.at(url).css ? path.concat(".css") : path;
+}
+
+
+// function return absolute URLs of remote references in HTML document (if base is empty) or in style sheet,
+// with flags of style sheets; in HTML only images, style sheet links, and url() in styles are considered
+std::vector<std::pair<std::string, bool>> asset_prefetcher::remote_references(std::string_view text, std::string_view base) const
+{
+  std::vector<std::pair<std::string, bool>> refs;
+  for(const auto& e: reference_spans(text)) {
+    auto url = reference_url(text, e, base);
+    if(!url.empty()) refs.emplace_back(url, e.token == "href=" || e.token == "@import");
+  }
+  return refs;
+}
+
+
+// function return absolute URL of reference, if it is fetched by prefetcher
+std::string asset_prefetcher::reference_url(std::string_view text, const reference_span& e, std::string_view base) const
+{
+  std::string ref(text.substr(e.pos, e.size));
+  if(ref.empty() || ref.front() == '#' || ref.starts_with("data:")) return {};
+  if(base.empty()) {
+    auto tag_begin = text.rfind('<', e.pos);
+    auto tag_end = text.find('>', e.pos);
+    if(e.token == "src=" || e.token == "href=") {
+      if(tag_begin == text.npos) return {};
+      std::string tag(text.substr(tag_begin, (tag_end == text.npos ? text.size() : tag_end) - tag_begin));
+      std::transform(tag.begin(), tag.end(), tag.begin(), [](unsigned char c){ return std::tolower(c); });
+      bool image = e.token == "src=" && tag.starts_with("<img");
+      bool style_sheet = e.token == "href=" && tag.starts_with("<link") && tag.find("stylesheet") != tag.npos;
+      if(!image && !style_sheet) return {};
+    }
+    for(auto pos = ref.find("&amp;"); pos != ref.npos; pos = ref.find("&amp;", pos + 1)) ref.replace(pos, 5, "&");
+  } else {
+    ref = resolve_url(base, ref);
+  }
+  auto parts = url_parts::parse(ref);
+  if(!parts || !http_client::supports(parts->scheme) || !allowed(parts->host)) return {};
+  return parts->str();
+}
+
+
+// function return text with remote references replaced by paths of local copies; relative references of style sheet
+// are made absolute, as its copy is read from another location
+std::string asset_prefetcher::rewrite(std::string_view text, std::string_view base) const
+{
+  std::string r;
+  size_t last {};
+  for(const auto& e: reference_spans(text)) {
+    auto url = reference_url(text, e, base);
+    std::string replacement;
+    if(auto it = assets_.find(url); !url.empty() && it != assets_.end() && it->second.ok) {
+      replacement = local_path(url).generic_string();
+    } else if(auto ref = text.substr(e.pos, e.size); !base.empty() && !ref.empty() && ref.front() != '#' && !ref.starts_with("data:")) {
+      replacement = resolve_url(base, ref);
+    }
+    if(replacement.empty()) continue;
+    if(!e.quoted) replacement = '"' + replacement + '"';
+    r.append(text.substr(last, e.pos - last)).append(replacement);
+    last = e.pos + e.size;
+  }
+  return r.append(text.substr(last));
+}
+
+
+void asset_prefetcher::request(const std::string& url, bool css)
+{
+  auto [it, inserted] = assets_.try_emplace(url);
+  it->second.css |= css;
+  if(inserted) pending_.push_back(url);
+}
+
+
+// function use fresh copy of asset, or queue its download or revalidation
+void asset_prefetcher::start(const std::string& url)
+{
+  auto& a = assets_[url];
+  nw::ifstream is ( fs::path(data_path(url)).concat(".meta") );
+  std::string header;
+  if(std::getline(is, header) && header == "dompdfui asset 1" && fs::exists(data_path(url))) {
+    auto& m = a.meta;
+    std::string expires;
+    a.cached = std::getline(is, m.url) && std::getline(is, m.etag) && std::getline(is, m.last_modified)
+               && std::getline(is, m.content_type) && std::getline(is, expires);
+    if(a.cached) m.expires = std::atoll(expires.c_str());
+    // copy redirected from a host, which isn't allowed now, is downloaded again
+    auto parts = url_parts::parse(m.url);
+    a.cached = a.cached && parts && allowed(parts->host);
+  }
+  if(a.cached && a.meta.expires > now()) {
+    a.ok = true;
+    a.css |= a.meta.content_type.starts_with("text/css");
+    ++fresh;
+    return;
+  }
+  http_client::headers_type headers;
+  if(a.cached && !a.meta.etag.empty()) headers.emplace_back("If-None-Match", a.meta.etag);
+  if(a.cached && !a.meta.last_modified.empty()) headers.emplace_back("If-Modified-Since", a.meta.last_modified);
+  client_->get(url, headers, [this, url](http_response r){ finish(url, std::move(r)); });
+}
+
+
+// function store downloaded asset, or keep its cached copy if it isn't modified or the server isn't available
+void asset_prefetcher::finish(const std::string& url, http_response r)
+{
+  auto& a = assets_[url];
+  auto path = data_path(url);
+  try {
+    if(r.status == 200) {
+      write_file_atomic(path, r.body);
+      a.meta = { r.url, r.etag, r.last_modified, r.content_type, expires(r.cache_control) };
+      a.css |= a.meta.content_type.starts_with("text/css");
+      write_meta(path, a.meta);
+      a.ok = true;
+      ++downloaded;
+    } else if(r.status == 304 && a.cached) {
+      a.meta.expires = expires(r.cache_control);
+      write_meta(path, a.meta);
+      a.ok = true;
+      ++revalidated;
+    } else {
+      a.ok = a.cached && (r.status == 0 || r.status >= 500);
+      ++failed;
+    }
+  }
+  catch(const std::exception&) {
+    ++failed;
+  }
+}
+
+
+bool asset_prefetcher::allowed(const std::string& host) const
+{
+  return allowed_hosts_.empty() || allowed_hosts_.count(host);
+}
+
+
+void asset_prefetcher::write_meta(const fs::path& path, const asset_meta& m)
+{
+  std::ostringstream os;
+  os << "dompdfui asset 1\n" << m.url << '\n' << m.etag << '\n' << m.last_modified << '\n'
+     << m.content_type << '\n' << m.expires << '\n';
+  write_file_atomic(fs::path(path).concat(".meta"), os.str());
+}
+
+
+long long asset_prefetcher::now()
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// function return time until which asset is fresh according to Cache-Control header
+long long asset_prefetcher::expires(const std::string& cache_control)
+{
+  if(cache_control.find("no-cache") != cache_control.npos || cache_control.find("no-store") != cache_control.npos) return 0;
+  auto pos = cache_control.find("max-age=");
+  return pos == cache_control.npos ? 0 : now() + std::atoll(cache_control.c_str() + pos + 8);
+}
+
+
+// function return value of attribute of HTML tag, or nothing if the tag hasn't it
+std::optional<std::string> tag_attribute(std::string_view tag, std::string_view name)
+{
+  std::string lower(tag);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+  for(auto pos = lower.find(name); pos != lower.npos; pos = lower.find(name, pos + 1)) {
+    auto end = lower.find_first_not_of(" \t\r\n", pos + name.size());
+    if(!pos || !std::isspace(static_cast<unsigned char>(lower[pos - 1])) || end == lower.npos || lower[end] != '=') continue;
+    auto begin = lower.find_first_not_of(" \t\r\n", end + 1);
+    if(begin == lower.npos) return std::string();
+    if(tag[begin] == '"' || tag[begin] == '\'') {
+      auto close = tag.find(tag[begin], begin + 1);
+      return std::string(tag.substr(begin + 1, (close == tag.npos ? tag.size() : close) - begin - 1));
+    }
+    return std::string(tag.substr(begin, tag.find_first_of(" \t\r\n>", begin) - begin));
+  }
+  return {};
+}
+
+
+// function return value of CSS property in style attribute, or nothing if it isn't set there
+std::optional<std::string> style_property(std::string_view style, std::string_view name)
+{
+  std::string lower(style);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+  std::optional<std::string> value;
+  for(auto pos = lower.find(name); pos != lower.npos; pos = lower.find(name, pos + 1)) {
+    // e.g. "max-width" and "border-width" are other properties
+    if(pos && (std::isalnum(static_cast<unsigned char>(lower[pos - 1])) || lower[pos - 1] == '-')) continue;
+    auto colon = lower.find_first_not_of(" \t\r\n", pos + name.size());
+    if(colon == lower.npos || lower[colon] != ':') continue;
+    auto end = lower.find(';', colon);
+    value = lower.substr(colon + 1, end == lower.npos ? lower.npos : end - colon - 1);
+  }
+  return value;
+}
+
+
+// function return CSS length in pixels at given dpi, as Dompdf converts it, or -1 if it depends on layout
+double css_length_px(std::string value, double dpi)
+{
+  value.erase(0, value.find_first_not_of(" \t\r\n"));
+  value.erase(value.find_last_not_of(" \t\r\n") + 1);
+  if(auto important = value.find("!important"); important != value.npos) value.erase(value.find_last_not_of(" \t", important - 1) + 1);
+  char* end {};
+  double v = std::strtod(value.c_str(), &end);
+  if(end == value.c_str() || v <= 0) return -1;
+  std::string unit(end);
+  std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char c){ return std::tolower(c); });
+  if(unit.empty() || unit == "px") return v;
+  if(unit == "in") return v * dpi;
+  if(unit == "cm") return v * dpi / 2.54;
+  if(unit == "mm") return v * dpi / 25.4;
+  if(unit == "pt") return v * dpi / 72;
+  if(unit == "pc") return v * dpi / 6;
+  return -1;
+}
+
+
+// function downscale image by averaging source pixels covered by each target pixel
+std::vector<unsigned char> downscale_image(const unsigned char* src, int sw, int sh, int channels, int dw, int dh)
+{
+  // weights of source columns (or rows) in each target column (or row)
+  auto weights = [](int s, int d){
+    std::vector<std::vector<std::pair<int, float>>> w(d);
+    double scale = double(s) / d;
+    for(int i=0; i<d; ++i) {
+      double begin = i * scale, end = (i + 1) * scale;
+      for(int j = int(begin); j < std::min(s, int(std::ceil(end))); ++j) {
+        double cover = std::min(end, j + 1.0) - std::max(begin, double(j));
+        if(cover > 0) w[i].emplace_back(j, float(cover / scale));
+      }
+    }
+    return w;
+  };
+  auto wx = weights(sw, dw), wy = weights(sh, dh);
+  // columns are reduced first, then rows
+  std::vector<float> rows(size_t(sh) * dw * channels);
+  for(int y=0; y<sh; ++y) {
+    for(int x=0; x<dw; ++x) {
+      for(const auto& [j, w]: wx[x]) {
+        for(int c=0; c<channels; ++c) rows[(size_t(y) * dw + x) * channels + c] += w * src[(size_t(y) * sw + j) * channels + c];
+      }
+    }
+  }
+  std::vector<unsigned char> dst(size_t(dh) * dw * channels);
+  for(int y=0; y<dh; ++y) {
+    for(int x=0; x<dw; ++x) {
+      for(int c=0; c<channels; ++c) {
+        float v {};
+        for(const auto& [j, w]: wy[y]) v += w * rows[(size_t(j) * dw + x) * channels + c];
+        dst[(size_t(y) * dw + x) * channels + c] = static_cast<unsigned char>(std::clamp(v + 0.5f, 0.0f, 255.0f));
+      }
+    }
+  }
+  return dst;
+}
+
+
+// function return local path of image source, or empty path if it isn't local file
+fs::path local_image_path(std::string src)
+{
+  if(src.starts_with("file://")) src.erase(0, 7);
+  fs::path path(src);
+  return path.is_absolute() ? path.lexically_normal() : fs::path();
+}
+
+
+// function decode base64 data of data URI
+std::string base64_decode(std::string_view s)
+{
+  std::string r;
+  unsigned buffer {}, bits {};
+  for(unsigned char c: s) {
+    int v = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 : c >= '0' && c <= '9' ? c - '0' + 52
+          : c == '+' || c == '-' ? 62 : c == '/' || c == '_' ? 63 : -1;
+    if(v < 0) continue;
+    buffer = buffer << 6 | v;
+    bits += 6;
+    if(bits >= 8) {
+      bits -= 8;
+      r += char(buffer >> bits & 0xff);
+    }
+  }
+  return r;
+}
+
+
+image_optimizer::image_optimizer(const fs::path& dir, const Options& options)
+  : dir_(dir), quality_(std::clamp(options.image_quality, 1u, 100u)), dpi_(options.dpi > 0 ? options.dpi : 96)
+{
+  fs::create_directories(dir_);
+  std::vector<std::string> chroot = options.chroot;
+  if(chroot.empty() && options.rootDir) chroot.push_back(*options.rootDir);
+  for(const auto& e: chroot) {
+    boost::tokenizer<boost::char_separator<char>> dirs(e, boost::char_separator<char>(";,"));
+    for(const auto& d: dirs) allowed_dirs_.push_back(fs::absolute(d).lexically_normal());
+  }
+  if(options.asset_cache) allowed_dirs_.push_back(fs::absolute(*options.asset_cache).lexically_normal());
+}
+
+
+std::vector<std::string> image_optimizer::optimize(const std::vector<std::string>& docs, unsigned threads)
+{
+  struct image {
+    size_t doc;
+    reference_span span;
+    size_t job;
+  };
+  std::vector<image> images;
+  std::map<std::tuple<std::string, int, int>, size_t> job_index;
+  for(size_t i=0; i<docs.size(); ++i) {
+    std::string_view text = docs[i];
+    for(const auto& e: reference_spans(text)) {
+      auto tag_begin = text.rfind('<', e.pos);
+      if(e.token != "src=" || tag_begin == text.npos) continue;
+      auto tag = text.substr(tag_begin, std::min(text.find('>', e.pos), text.size()) - tag_begin);
+      if(tag.size() < 5 || !std::equal(tag.begin(), tag.begin() + 4, "<img", [](char a, char b){ return std::tolower(static_cast<unsigned char>(a)) == b; }))
+        continue;
+      job j;
+      j.src = text.substr(e.pos, e.size);
+      if(!source_allowed(j.src)) continue;
+      // size of the image in document; style overrides attributes
+      double width = css_length_px(tag_attribute(tag, "width").value_or(""), dpi_);
+      double height = css_length_px(tag_attribute(tag, "height").value_or(""), dpi_);
+      if(auto style = tag_attribute(tag, "style")) {
+        if(auto v = style_property(*style, "width")) width = css_length_px(*v, dpi_);
+        if(auto v = style_property(*style, "height")) height = css_length_px(*v, dpi_);
+      }
+      j.width = width > 0 ? int(std::ceil(width)) : 0;
+      j.height = height > 0 ? int(std::ceil(height)) : 0;
+      auto [it, inserted] = job_index.try_emplace({j.src, j.width, j.height}, jobs_.size());
+      if(inserted) jobs_.push_back(std::move(j));
+      images.push_back({i, e, it->second});
+    }
+  }
+
+  std::atomic<size_t> next_job {};
+  auto worker = [&](){
+    for(size_t n = next_job++; n < jobs_.size(); n = next_job++) {
+      try {
+        process(jobs_[n]);
+      }
+      catch(const std::exception&) {
+        // image, which can't be read or decoded, is left for Dompdf
+        ++kept;
+      }
+    }
+  };
+  if(!jobs_.empty()) {
+    std::vector<std::jthread> workers;
+    for(size_t i=0; i<std::clamp<size_t>(threads, 1, jobs_.size()); ++i) workers.emplace_back(worker);
+  }
+
+
+  std::vector<std::string> rewritten(docs.size());
+  std::vector<size_t> last(docs.size());
+  std::vector<char> changed(docs.size());
+  for(const auto& e: images) {
+    const auto& result = jobs_[e.job].result;
+    if(result.empty()) continue;
+    rewritten[e.doc].append(docs[e.doc], last[e.doc], e.span.pos - last[e.doc])
+                    .append(e.span.quoted ? result.generic_string() : '"' + result.generic_string() + '"');
+    last[e.doc] = e.span.pos + e.span.size;
+    changed[e.doc] = true;
+  }
+  for(size_t i=0; i<docs.size(); ++i) {
+    if(changed[i]) rewritten[i].append(docs[i], last[i]);
+  }
+  return rewritten;
+}
+
+
+// function return true if image is data URI or local file, which Dompdf may read according to chroot
+bool image_optimizer::source_allowed(const std::string& src) const
+{
+  if(src.starts_with("data:image/")) return src.find(";base64,") != src.npos;
+  auto path = local_image_path(src);
+  if(path.empty()) return false;
+  return std::any_of(allowed_dirs_.begin(), allowed_dirs_.end(), [&path](const auto& dir){
+    auto rel = path.lexically_relative(dir);
+    return !rel.empty() && *rel.begin() != "..";
+  });
+}
+
+
+// function set result of job to optimized copy of image, if it is smaller than the source
+void image_optimizer::process(job& j)
+{
+  std::string data;
+  if(j.src.starts_with("data:")) {
+    data = base64_decode(std::string_view(j.src).substr(j.src.find(";base64,") + 8));
+  } else {
+    nw::ifstream is ( local_image_path(j.src), std::ios::binary );
+    if(!is.is_open()) throw std::runtime_error("Can't open file: " + j.src) ;
+    data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+  }
+  auto key = sha256().update("dompdfui image 2 " + std::to_string(j.width) + 'x' + std::to_string(j.height) + ' '
+                             + std::to_string(quality_) + '\n').update(data).hexdigest();
+  auto base = dir_ / key.substr(0, 2) / key;
+  // ".keep" marks images, which can't be made smaller
+  for(auto ext: { ".jpg", ".png", ".keep" }) {
+    if(!fs::exists(fs::path(base).concat(ext))) continue;
+    if(std::string(ext) != ".keep") j.result = fs::path(base).concat(ext);
+    ++(j.result.empty() ? kept : cached);
+    return;
+  }
+
+  int w, h, channels;
+  std::unique_ptr<unsigned char, void(*)(void*)> pixels {
+    stbi_load_from_memory(reinterpret_cast<const unsigned char*>(data.data()), int(data.size()), &w, &h, &channels, 0),
+    stbi_image_free };
+  if(!pixels) throw std::runtime_error("Can't decode image: " + std::string(stbi_failure_reason()));
+  // size in document keeps aspect ratio, if only one dimension is given
+  int dw = j.width, dh = j.height;
+  if(dw && !dh) dh = std::max(1, int(std::lround(double(h) * dw / w)));
+  if(dh && !dw) dw = std::max(1, int(std::lround(double(w) * dh / h)));
+  bool downscale = dw && dh && (dw < w || dh < h);
+  bool jpeg = data.size() > 2 && static_cast<unsigned char>(data[0]) == 0xff && static_cast<unsigned char>(data[1]) == 0xd8;
+  // JPEG isn't recompressed at the same size, not to lose quality twice
+  if(!downscale && jpeg) {
+    write_file_atomic(fs::path(base).concat(".keep"), {});
+    ++kept;
+    return;
+  }
+  std::vector<unsigned char> scaled;
+  const unsigned char* p = pixels.get();
+  if(downscale) {
+    dw = std::min(dw, w);
+    dh = std::min(dh, h);
+    scaled = downscale_image(p, w, h, channels, dw, dh);
+    p = scaled.data();
+  } else {
+    dw = w;
+    dh = h;
+  }
+  // JPEG stays JPEG, and the rest become PNG: line art, screenshots and text in images are not
+  // degraded by lossy compression
+  std::string encoded;
+  auto append = [](void* context, void* bytes, int size){
+    static_cast<std::string*>(context)->append(static_cast<const char*>(bytes), size);
+  };
+  bool ok = jpeg ? stbi_write_jpg_to_func(append, &encoded, dw, dh, channels, p, quality_)
+                 : stbi_write_png_to_func(append, &encoded, dw, dh, channels, p, dw * channels);
+  if(!ok || encoded.size() >= data.size()) {
+    write_file_atomic(fs::path(base).concat(".keep"), {});
+    ++kept;
+    return;
+  }
+  j.result = fs::path(base).concat(jpeg ? ".jpg" : ".png");
+  write_file_atomic(j.result, encoded);
+  ++optimized;
+  bytes_before += data.size();
+  bytes_after += encoded.size();
+}
+
+
+// function split HTML document to parts of about part_size bytes, which are converted separately and merged;
+// parts are cut at page breaks and before rows of tables, which are not nested in other tables; elements open
+// at a cut are closed at the end of the part and opened again in the next one, with header of the table, and
+// each part gets the whole head of the document; nothing is returned if the document can't be split, e.g. it
+// numbers pages, or has fixed elements repeated on each page
+std::vector<std::string> split_html(std::string_view html, size_t part_size)
+{
+  std::string lower(html);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+  auto has_property = [&lower](std::string_view name, std::string_view value){
+    for(auto pos = lower.find(name); pos != lower.npos; pos = lower.find(name, pos + 1)) {
+      auto colon = lower.find_first_not_of(" \t\r\n", pos + name.size());
+      if(colon == lower.npos || lower[colon] != ':') continue;
+      auto v = lower.find_first_not_of(" \t\r\n", colon + 1);
+      if(v != lower.npos && lower.compare(v, value.size(), value) == 0) return true;
+    }
+    return false;
+  };
+  if(lower.find("counter(page") != lower.npos || lower.find("text/php") != lower.npos || has_property("position", "fixed")) return {};
+  auto body = lower.find("<body");
+  auto body_begin = body == lower.npos ? lower.npos : lower.find('>', body);
+  if(body_begin == lower.npos) return {};
+  ++body_begin;
+  auto body_end = lower.rfind("</body");
+  if(body_end == lower.npos || body_end < body_begin) body_end = lower.size();
+
+  // classes of style sheets, which break page before or after elements
+  auto breaks_page = [](std::string_view value){
+    std::string v(value);
+    boost::tokenizer<boost::char_separator<char>> tokens(v, boost::char_separator<char>(" \t\r\n!"));
+    return std::any_of(tokens.begin(), tokens.end(), [](const std::string& e){
+      return e == "always" || e == "page" || e == "left" || e == "right" || e == "recto" || e == "verso";
+    });
+  };
+  std::set<std::string> break_classes[2];
+  for(auto pos = lower.find("<style"); pos != lower.npos; pos = lower.find("<style", pos + 1)) {
+    auto begin = lower.find('>', pos);
+    auto end = lower.find("</style", pos);
+    if(begin == lower.npos || end == lower.npos || begin > end) break;
+    for(auto brace = lower.find('{', begin); brace < end; brace = lower.find('{', brace + 1)) {
+      auto rule_end = std::min(lower.find('}', brace), end);
+      auto selectors_begin = lower.find_last_of("{}>", brace - 1) + 1;
+      std::string rule = lower.substr(brace + 1, rule_end - brace - 1);
+      for(int side=0; side<2; ++side) {
+        auto v = style_property(rule, side ? "page-break-after" : "page-break-before");
+        if(!v) v = style_property(rule, side ? "break-after" : "break-before");
+        if(!v || !breaks_page(*v)) continue;
+        boost::tokenizer<boost::char_separator<char>> selectors(lower.substr(selectors_begin, brace - selectors_begin),
+                                                                boost::char_separator<char>(", \t\r\n"));
+        for(const auto& s: selectors) {
+          auto dot = s.find('.');
+          if(dot != s.npos && s.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789-_", dot + 1) == s.npos
+             && s.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789") >= dot)
+            break_classes[side].insert(s.substr(dot + 1));
+        }
+      }
+    }
+  }
+  // function return true, if element breaks page before (side 0) or after (side 1) it
+  auto page_break = [&](std::string_view tag, int side){
+    if(auto style = tag_attribute(tag, "style")) {
+      auto v = style_property(*style, side ? "page-break-after" : "page-break-before");
+      if(!v) v = style_property(*style, side ? "break-after" : "break-before");
+      if(v && breaks_page(*v)) return true;
+    }
+    if(auto classes = tag_attribute(tag, "class")) {
+      boost::tokenizer<boost::char_separator<char>> names(*classes, boost::char_separator<char>(" \t\r\n"));
+      for(const auto& e: names) if(break_classes[side].count(e)) return true;
+    }
+    return false;
+  };
+
+  struct element {
+    std::string name;
+    size_t begin;             // position of opening tag
+    std::string_view tag;     // opening tag
+    std::string header;       // for table: its columns and header, which are repeated in each part
+    bool break_after;
+    size_t rows;              // for table: number of its rows
+  };
+  static const std::set<std::string, std::less<>> void_elements {
+    "area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "param", "source", "track", "wbr" };
+  static const std::set<std::string, std::less<>> raw_text_elements { "script", "style", "textarea", "title", "xmp" };
+  static const std::set<std::string, std::less<>> block_elements {
+    "div", "section", "article", "main", "header", "footer", "aside", "nav", "center", "blockquote", "form" };
+  std::vector<element> open, last_open;
+  std::vector<std::string> parts;
+  auto prefix = html.substr(0, body_begin), suffix = html.substr(body_end);
+  size_t last = body_begin;
+  auto part = [&](size_t end, bool close){
+    std::string r(prefix);
+    for(const auto& e: last_open) r.append(e.tag).append(e.header);
+    r.append(html.substr(last, end - last));
+    if(close) for(auto e = open.rbegin(); e != open.rend(); ++e) r.append("</").append(e->name).append(">");
+    return r.append(suffix);
+  };
+  // function cut part at given position, if it is large enough and elements open there can be reopened
+  auto cut = [&](size_t pos, bool in_table){
+    if(pos - last < part_size) return;
+    size_t tables {};
+    for(const auto& e: open) {
+      if(e.name == "table") ++tables;
+      else if(!(in_table && e.name == "tbody") && !block_elements.count(e.name)) return;
+    }
+    if(tables != (in_table ? 1 : 0)) return;
+    parts.push_back(part(pos, true));
+    last = pos;
+    last_open = open;
+  };
+  // function close element; columns and header of table are kept to repeat them
+  auto pop = [&](size_t end){
+    auto e = std::move(open.back());
+    open.pop_back();
+    if((e.name == "thead" || e.name == "colgroup") && !open.empty() && open.back().name == "table")
+      open.back().header.append(html.substr(e.begin, end - e.begin));
+    return e;
+  };
+  auto pop_while = [&](size_t end, std::initializer_list<std::string_view> names){
+    while(!open.empty() && std::find(names.begin(), names.end(), open.back().name) != names.end()) pop(end);
+  };
+
+  for(size_t pos = body_begin; pos < body_end; ) {
+    auto lt = lower.find('<', pos);
+    if(lt >= body_end) break;
+    if(lower.compare(lt, 4, "<!--") == 0) {
+      auto end = lower.find("-->", lt + 4);
+      pos = end == lower.npos ? body_end : end + 3;
+      continue;
+    }
+    bool closing = lt + 1 < body_end && lower[lt + 1] == '/';
+    auto name_begin = lt + 1 + closing;
+    auto name_end = std::min(lower.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789-", name_begin), body_end);
+    if(name_end == name_begin) {
+      pos = lt + 1;
+      continue;
+    }
+    // end of tag, skipping quoted attribute values
+    auto gt = name_end;
+    for(char quote = 0; gt < body_end && (quote || lower[gt] != '>'); ++gt) {
+      if(quote && lower[gt] == quote) quote = 0;
+      else if(!quote && (lower[gt] == '"' || lower[gt] == '\'')) quote = lower[gt];
+    }
+    if(gt >= body_end) break;
+    auto name = lower.substr(name_begin, name_end - name_begin);
+    auto tag = html.substr(lt, gt + 1 - lt);
+    pos = gt + 1;
+
+    if(closing) {
+      auto it = std::find_if(open.rbegin(), open.rend(), [&name](const auto& e){ return e.name == name; });
+      if(it == open.rend()) continue;
+      while(open.size() > size_t(std::distance(it, open.rend()))) pop(lt);
+      if(pop(pos).break_after) cut(pos, false);
+      continue;
+    }
+    // end tags, which may be omitted
+    if(name == "tr") pop_while(lt, { "td", "th", "tr" });
+    else if(name == "td" || name == "th") pop_while(lt, { "td", "th" });
+    else if(name == "thead" || name == "tbody" || name == "tfoot") pop_while(lt, { "td", "th", "tr", "thead", "tbody", "tfoot" });
+    else if(name == "li" || name == "p") pop_while(lt, { name });
+
+    auto table = std::find_if(open.rbegin(), open.rend(), [](const auto& e){ return e.name == "table"; });
+    // stray row without table is not a place to cut
+    bool row = name == "tr" && table != open.rend() && (open.back().name == "table" || open.back().name == "tbody");
+    if(row && table->rows++) cut(lt, true);
+    else if(!row && page_break(tag, 0)) cut(lt, false);
+
+    if(void_elements.count(name) || tag.ends_with("/>")) {
+      if(name == "col" && !open.empty() && open.back().name == "table") open.back().header.append(tag);
+      if(page_break(tag, 1)) cut(pos, false);
+      continue;
+    }
+    if(raw_text_elements.count(name)) {
+      auto end = lower.find("</" + name, pos);
+      pos = end == lower.npos ? body_end : end;
+      continue;
+    }
+    open.push_back({name, lt, tag, {}, page_break(tag, 1), 0});
+  }
+  if(parts.empty()) return {};
+  parts.push_back(part(body_end, false));
+  return parts;
+}
+
+
+batch_journal::batch_journal(const fs::path& path, const std::string& digest) : path_(path), digest_(digest)
+{
+  nw::ifstream is ( path_, std::ios::binary );
+  std::string content { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+  is.close();
+  std::istringstream ls(content);
+  for(std::string line; std::getline(ls, line) && !ls.eof(); ) {
+    auto tab1 = line.find('\t');
+    auto tab2 = tab1 == line.npos ? line.npos : line.find('\t', tab1 + 1);
+    if(tab2 != line.npos) entries_[line.substr(tab2 + 1)] = { line.substr(0, tab1), line.substr(tab1 + 1, tab2 - tab1 - 1) };
+  }
+  os_.open(path_, std::ios::binary | std::ios::app);
+  if(!os_.is_open()) throw std::runtime_error("Can't open file: " + path_.string()) ;
+  if(!content.empty() && content.back() != '\n') os_ << '\n';
+}
+
+
+bool batch_journal::done(const fs::path& in, const fs::path& out) const
+{
+  auto it = entries_.find(out.string());
+  return it != entries_.end() && it->second.first == digest_ && it->second.second == in.string();
+}
+
+
+void batch_journal::record(const fs::path& in, const fs::path& out)
+{
+  auto in_str = in.string(), out_str = out.string();
+  if((in_str + out_str).find_first_of("\t\n") != std::string::npos) return;
+  std::lock_guard lk(mutex_);
+  os_ << digest_ << '\t' << in_str << '\t' << out_str << '\n' << std::flush;
+  entries_[out_str] = { digest_, in_str };
+}
+
+
+void batch_journal::compact()
+{
+  std::lock_guard lk(mutex_);
+  os_.close();
+  auto tmp_path = fs::path(path_).concat(".tmp");
+  nw::ofstream os ( tmp_path, std::ios::binary );
+  if(!os.is_open()) throw std::runtime_error("Can't open file: " + tmp_path.string()) ;
+  for(const auto& [out, e]: entries_) os << e.first << '\t' << e.second << '\t' << out << '\n';
+  os.close();
+  if(!os) throw std::runtime_error("Can't write to file: " + tmp_path.string()) ;
+  fs::rename(tmp_path, path_);
+}
+
+} // namespace dompdfui
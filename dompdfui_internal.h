@@ -0,0 +1,304 @@
+#ifndef DOMPDFUI_INTERNAL_H
+#define DOMPDFUI_INTERNAL_H
+
+// parts of dompdfui library, which are shared with the command line interface, but aren't its public API
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/nowide/fstream.hpp>
+#include <boost/predef.h>
+#if BOOST_OS_UNIX
+#include <sys/types.h>
+#endif
+#include "dompdfui.h"
+
+class http_client;
+struct http_response;
+class sha256;
+
+namespace dompdfui {
+
+// result of child process
+struct process_result {
+  int exit_code {-1};   // exit status, if process exited normally
+  int signal {};        // number of signal, if process was killed by signal
+  std::string out;      // captured stdout
+  std::string err;      // captured stderr
+  double spawn_time {}; // seconds spent on starting process
+  double wall_time {};  // seconds from start of process to its exit
+  double user_time {};  // CPU time spent in user mode, seconds
+  double sys_time {};   // CPU time spent in kernel mode, seconds
+  long max_rss {};      // peak resident set size, KiB
+  bool ok() const { return !signal && !exit_code; }
+  std::string status_str() const;
+};
+
+extern std::filesystem::path php_exe_path;    // php-cli executable, extracted to runtime directory or loaded to memory
+
+double seconds_since(std::chrono::steady_clock::time_point start) ;
+process_result run_process(const std::filesystem::path&, const std::vector<std::string>&, const std::filesystem::path&) ;
+std::filesystem::path write_php_script(const std::string& prefix, const std::string& content) ;
+std::string php_options_script(const Options&, bool frozen_fonts = true) ;
+void set_writable(const std::filesystem::path& dir, bool writable) ;
+std::vector<std::string> php_ini_args(const Options&) ;
+std::string php_fonts_warmup_script() ;
+const std::string& runtime_key() ;
+std::filesystem::path temp_path() ;
+std::filesystem::path runtime_fonts_path() ;
+void extract_embedded_resources(const Options&) ;
+void remove_runtime() ;
+
+#if BOOST_OS_UNIX
+
+pid_t spawn_process(const std::filesystem::path&, const std::vector<std::string>&, const std::filesystem::path&, int, int, int) ;
+bool write_all(int fd, const char* p, size_t n) ;
+bool write_all(int fd, const std::string& s) ;
+bool read_exact(int fd, char* p, size_t n) ;
+bool read_line(int fd, std::string& line) ;
+bool read_reply(int fd, std::string& status, std::string& data) ;
+
+// php-cli process with stdin and stdout connected to pipes, and stderr to an unlinked temp file
+struct php_worker {
+  pid_t pid {-1};
+  int in {-1};
+  int out {-1};
+  int err {-1};
+  unsigned jobs_done {};
+};
+
+php_worker spawn_php_worker(const std::vector<std::string>& args) ;
+void stop_php_worker(php_worker& w, bool kill_it) ;
+std::string php_worker_error(const php_worker& w) ;
+unsigned long long process_rss(pid_t pid) ;
+std::string php_worker_script(const Options&) ;
+
+#endif
+
+std::string options_digest(const Options&) ;
+
+
+// processing of documents, which is given by Options and shared by converter and command line;
+// it is implemented in dompdfui_documents.cpp
+
+// reference to external resource in HTML or CSS text
+struct reference_span {
+  std::string_view token;   // "src=", "href=", "url(" or "@import"
+  size_t pos;               // position of value in text
+  size_t size;              // size of value, without quotes
+  bool quoted;              // value is enclosed in quotes
+};
+
+std::vector<reference_span> reference_spans(std::string_view text) ;
+std::vector<std::string> resource_references(std::string_view text) ;
+std::string read_file(const std::filesystem::path&) ;
+void clone_file(const std::filesystem::path& from, const std::filesystem::path& to) ;
+void write_file_atomic(const std::filesystem::path& path, std::string_view content) ;
+std::vector<std::string> split_html(std::string_view html, size_t part_size) ;
+
+
+// writable font directory of a worker in temp directory, where its php-cli processes install fonts
+// of @font-face rules; it is created once, kept by restarted processes, and removed with the object
+class font_install_dir {
+public:
+  font_install_dir();
+  ~font_install_dir();
+  font_install_dir(const font_install_dir&) = delete;
+  font_install_dir& operator=(const font_install_dir&) = delete;
+
+  // function return php-cli arguments, which pass the directory to the script
+  std::vector<std::string> php_args() const;
+
+private:
+  std::filesystem::path path_;
+};
+
+
+// cache of converted documents, keyed by content of HTML and its local assets, Dompdf options and versions;
+// entries are stored as DIR/XX/KEY.pdf, and least recently used ones are evicted when size limit is exceeded
+class output_cache {
+public:
+  output_cache(const std::filesystem::path& dir, uintmax_t max_size);
+
+  // function return key of document, which references local files relative to base_dir,
+  // or empty string if it can't be cached (e.g. it references remote resources)
+  std::string key(std::string_view html, const std::filesystem::path& base_dir, const Options& options) const;
+
+  // functions copy cached document to output file, or return it, and fail if it isn't cached
+  bool fetch_file(const std::string& key, const std::filesystem::path& out);
+  std::optional<std::string> fetch(const std::string& key);
+
+  // functions put converted document to cache; entry appears atomically, so concurrent instances may share cache
+  void store_file(const std::string& key, const std::filesystem::path& out);
+  void store(const std::string& key, std::string_view pdf);
+
+  // function remove least recently used entries until cache fits its size limit, and return their number
+  size_t evict();
+
+  std::atomic<size_t> hits {}, misses {};
+
+private:
+  std::filesystem::path entry(const std::string& key) const;
+  bool add_file(::sha256& h, const std::filesystem::path& file, std::string_view content, bool scan,
+                bool remote_enabled, std::set<std::filesystem::path>& visited) const;
+
+  std::filesystem::path dir_;
+  uintmax_t max_size_;
+};
+
+
+// cache of remote assets of documents: assets are downloaded concurrently before conversion, and documents are
+// rewritten to reference the local copies, so that Dompdf doesn't fetch them one by one for each document;
+// each asset is stored as DIR/XX/KEY with KEY.meta, where KEY is hash of its URL, and is revalidated with ETag
+// and Last-Modified when it isn't fresh; style sheets get KEY.css copy with their references rewritten as well
+class asset_prefetcher {
+public:
+  asset_prefetcher(const std::filesystem::path& dir, const Options& options);
+  ~asset_prefetcher();
+
+  // function download remote assets of documents, and return documents referencing local copies,
+  // or empty strings for documents without remote assets
+  std::vector<std::string> prefetch(const std::vector<std::string>& docs);
+
+  size_t downloaded {}, revalidated {}, fresh {}, failed {};
+
+private:
+  struct asset_meta {
+    std::string url;              // URL of the response, after redirects
+    std::string etag, last_modified, content_type;
+    long long expires {};         // time until which the asset is used without revalidation
+  };
+  struct asset {
+    bool css {};                  // asset is a style sheet
+    bool cached {};               // asset has a copy in cache
+    bool ok {};                   // local copy may be used
+    asset_meta meta;
+  };
+
+  std::filesystem::path data_path(const std::string& url) const;
+  std::filesystem::path local_path(const std::string& url) const;
+  std::vector<std::pair<std::string, bool>> remote_references(std::string_view text, std::string_view base) const;
+  std::string reference_url(std::string_view text, const reference_span& e, std::string_view base) const;
+  std::string rewrite(std::string_view text, std::string_view base) const;
+  void request(const std::string& url, bool css);
+  void start(const std::string& url);
+  void finish(const std::string& url, http_response r);
+  bool allowed(const std::string& host) const;
+  static long long now();
+  static long long expires(const std::string& cache_control);
+  static void write_meta(const std::filesystem::path& path, const asset_meta& m);
+
+  std::filesystem::path dir_;
+  unsigned connections_;
+  std::unique_ptr<http_client> client_;
+  std::set<std::string> allowed_hosts_;
+  std::map<std::string, asset> assets_;
+  std::vector<std::string> pending_;
+};
+
+
+// optimizer of images of documents: local and data URI images are decoded in several threads, downscaled to the size
+// they are laid out with at dpi, and recompressed; documents are rewritten to reference optimized copies, which are
+// stored as DIR/XX/KEY.jpg or DIR/XX/KEY.png, where KEY is hash of source image, target size and quality.
+// Local images are optimized only inside chroot of Dompdf and asset_cache, as Dompdf wouldn't read the rest
+class image_optimizer {
+public:
+  image_optimizer(const std::filesystem::path& dir, const Options& options);
+
+  // function replace images of documents by optimized copies, and return changed documents,
+  // or empty strings for unchanged ones
+  std::vector<std::string> optimize(const std::vector<std::string>& docs, unsigned threads);
+
+  std::atomic<size_t> optimized {}, cached {}, kept {};
+  std::atomic<uintmax_t> bytes_before {}, bytes_after {};
+
+private:
+  struct job {
+    std::string src;    // value of src attribute
+    int width {};       // size of the image in document in pixels at dpi, or 0 if unknown
+    int height {};
+    std::filesystem::path result;  // optimized copy, or empty path if the source is left as is
+  };
+
+  bool source_allowed(const std::string& src) const;
+  void process(job& j);
+
+  std::filesystem::path dir_;
+  std::vector<std::filesystem::path> allowed_dirs_;
+  unsigned quality_;
+  double dpi_;
+  std::vector<job> jobs_;
+};
+
+
+// model of memory used by php-cli to convert a document; memory limit of a document is estimated from peaks
+// of the same file in past runs, or from its size and the memory per input byte seen for other files;
+// peaks are kept in a state file between runs as "PEAK SIZE TIME PATH" lines
+class memory_model {
+public:
+  memory_model(const std::filesystem::path& state_path, unsigned long long default_limit, unsigned long long max_limit);
+
+  // function return memory limit for document; unknown documents get the default limit until there is history
+  unsigned long long limit(const std::filesystem::path& file, uintmax_t size) const;
+
+  // function remember peak memory of document, or memory limit exceeded by it
+  void record(const std::filesystem::path& file, uintmax_t size, unsigned long long peak);
+
+  // function write state file, keeping the most recent entries; it is replaced atomically,
+  // and failure to write it isn't an error of conversion
+  void save() const;
+
+private:
+  struct entry {
+    unsigned long long peak {};
+    uintmax_t size {};
+    long long time {};
+  };
+  static constexpr const char* header = "dompdfui memory state 1";
+  static constexpr unsigned long long base_memory = 16ull << 20;  // memory used by Dompdf without a document
+  static constexpr unsigned long long min_limit = 32ull << 20;
+  static constexpr size_t max_entries = 10000;
+
+  std::filesystem::path state_path_;
+  unsigned long long default_limit_, max_limit_;
+  double bytes_per_input_byte_ {-1};
+  std::map<std::string, entry> entries_;
+  std::mutex mutex_;
+};
+
+
+// journal of converted documents, which lets --incremental and --resume skip them in next runs;
+// each document is appended as "DIGEST<TAB>INPUT<TAB>OUTPUT" line as soon as it is converted,
+// where DIGEST is digest of options, and a line cut by a crash is ignored
+class batch_journal {
+public:
+  batch_journal(const std::filesystem::path& path, const std::string& digest);
+
+  // function return true, if document was converted with the same options
+  bool done(const std::filesystem::path& in, const std::filesystem::path& out) const;
+
+  // function append converted document, flushing the line at once, so that it survives a crash of the program
+  void record(const std::filesystem::path& in, const std::filesystem::path& out);
+
+  // function rewrite journal with the last line of each output, so that it doesn't grow with each run
+  void compact();
+
+private:
+  std::filesystem::path path_;
+  std::string digest_;
+  std::map<std::string, std::pair<std::string, std::string>> entries_;  // output => digest, input
+  boost::nowide::ofstream os_;
+  std::mutex mutex_;
+};
+
+} // namespace dompdfui
+
+#endif // DOMPDFUI_INTERNAL_H
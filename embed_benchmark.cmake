@@ -0,0 +1,48 @@
+# Generate embedded resources in each mode, and uncompressed in 'incbin' mode, and measure time of generation
+# and compilation; variants are name, mode and further arguments of generator
+foreach(VARIANT "source|source" "incbin|incbin" "incbin_uncompressed|incbin|--no-compress")
+  string(REPLACE "|" ";" VARIANT "${VARIANT}")
+  list(POP_FRONT VARIANT NAME MODE)
+  set(DIR "${WORK_DIR}/${NAME}")
+  file(REMOVE_RECURSE "${DIR}")
+  file(MAKE_DIRECTORY "${DIR}")
+  string(TIMESTAMP T0 "%s%f")
+  execute_process(COMMAND "${GENERATOR}" -m ${MODE} ${VARIANT} -o "${DIR}" "${DOMPDF_ZIP}" "${PHP_EXE}"
+                  COMMAND_ERROR_IS_FATAL ANY)
+  string(TIMESTAMP T1 "%s%f")
+  file(GLOB SOURCES "${DIR}/embed_resources.cpp" "${DIR}/embed_resources.S")
+  set(SOURCES_SIZE 0)
+  foreach(SRC ${SOURCES})
+    file(SIZE "${SRC}" SRC_SIZE)
+    math(EXPR SOURCES_SIZE "${SOURCES_SIZE} + ${SRC_SIZE}")
+    execute_process(COMMAND "${CXX}" -std=c++20 -O2 -I "${DIR}" -c "${SRC}" -o "${SRC}.o"
+                    COMMAND_ERROR_IS_FATAL ANY)
+  endforeach()
+  string(TIMESTAMP T2 "%s%f")
+  math(EXPR GENERATION_MS "(${T1} - ${T0}) / 1000")
+  math(EXPR COMPILATION_MS "(${T2} - ${T1}) / 1000")
+  math(EXPR SOURCES_KB "${SOURCES_SIZE} / 1024")
+  message(STATUS "${NAME}: sources ${SOURCES_KB} KB, generation ${GENERATION_MS} ms, compilation ${COMPILATION_MS} ms")
+endforeach()
+
+# Without --no-clean option the temp directory is removed on exit, so the second run starts cold; both executables
+# have the same runtime, so it is extracted from compressed and uncompressed resources alike
+foreach(VARIANT "dompdfui|${DOMPDFUI}" "dompdfui_uncompressed|${DOMPDFUI_UNCOMPRESSED}")
+  string(REPLACE "|" ";" VARIANT "${VARIANT}")
+  list(POP_FRONT VARIANT NAME EXE)
+  if(NOT EXE)
+    continue()
+  endif()
+  file(SIZE "${EXE}" EXE_SIZE)
+  math(EXPR EXE_KB "${EXE_SIZE} / 1024")
+  set(OUT_DIR "${WORK_DIR}/cold_start")
+  file(MAKE_DIRECTORY "${OUT_DIR}")
+  foreach(RUN 1 2)
+    string(TIMESTAMP T0 "%s%f")
+    execute_process(COMMAND "${EXE}" --force-out "${TEST_HTML}" "${OUT_DIR}"
+                    OUTPUT_QUIET COMMAND_ERROR_IS_FATAL ANY)
+    string(TIMESTAMP T1 "%s%f")
+  endforeach()
+  math(EXPR COLD_MS "(${T1} - ${T0}) / 1000")
+  message(STATUS "${NAME}: executable ${EXE_KB} KB, conversion with cold start ${COLD_MS} ms")
+endforeach()
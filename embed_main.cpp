@@ -7,6 +7,8 @@
 #include <boost/nowide/args.hpp>
 #include <boost/nowide/fstream.hpp>
 #include <boost/program_options.hpp>
+#include "miniz.h"
+#include "sha256.h"
 
 namespace fs = std::filesystem;
 namespace po = boost::program_options;
@@ -21,10 +23,17 @@ int main(int argc, char** argv)
   try {
     nw::args utf8_args (argc, argv);
     po::options_description opts("This program generate cpp-source files from set of "
-                                 "binary files, for embedding it to executable. \n\nOptions");
+                                 "binary files, for embedding it to executable. "
+                                 "Files are stored compressed, unless compression doesn't reduce their size "
+                                 "by 5% at least, or --no-compress is given. \n\nOptions");
     opts.add_options()
         ("help,h", "produce help message")
         ("output-dir,o", po::value<std::string>(), "output directory full path")
+        ("mode,m", po::value<std::string>()->default_value("source"),
+            "how resources are embedded: 'source' - as string literals in generated cpp-file, "
+            "'incbin' - as binary data included by assembler directive in generated S-file")
+        ("no-compress", po::bool_switch(), "store all files uncompressed, e.g. to compare size and start time "
+            "of executable with compressed resources")
     ;
     po::options_description hidden_opts("");
     std::vector<std::string> infiles_;
@@ -38,12 +47,16 @@ int main(int argc, char** argv)
     po::notify(vm);
     if (vm.count("help")) {
       nw::cout << "Usage: " << argv[0]
-               << " -o OUTDIR INFILE1 [INFILE2] [INFILE3] [...]\n"
+               << " [-m MODE] [--no-compress] -o OUTDIR INFILE1 [INFILE2] [INFILE3] [...]\n"
                << opts << "\n";
       return 0;
     }
     if (!vm.count("input-file") || !vm.count("output-dir"))
       throw std::runtime_error("the options 'OUTDIR' and 'INFILE1' is required but missing");
+    auto mode = vm["mode"].as<std::string>();
+    bool no_compress = vm["no-compress"].as<bool>();
+    if (mode != "source" && mode != "incbin")
+      throw std::runtime_error("unknown mode: " + mode);
     fs::path outdir (vm["output-dir"].as<std::string>());
     if(!fs::exists(outdir) || !fs::is_directory(outdir))
       throw std::runtime_error("Can't open directory: " + outdir.string());
@@ -98,11 +111,25 @@ int main(int argc, char** argv)
       "\n"
       "  struct EmbeddedCollection {\n"
       "    struct EmbeddedResource {\n"
-      "      constexpr EmbeddedResource(std::string_view data) : data_(data) {}\n"
+      "      constexpr EmbeddedResource(std::string_view data, size_t original_size,\n"
+      "                                 unsigned long crc32, std::string_view sha256, bool compressed)\n"
+      "        : data_(data), original_size_(original_size), crc32_(crc32), sha256_(sha256),\n"
+      "          compressed_(compressed) {}\n"
       "      constexpr auto data() { return data_.data(); }\n"
       "      constexpr auto size() { return data_.size(); }\n"
+      "      // size and CRC-32 of resource after decompression\n"
+      "      constexpr auto original_size() { return original_size_; }\n"
+      "      constexpr auto crc32() { return crc32_; }\n"
+      "      // hex SHA-256 digest of resource after decompression\n"
+      "      constexpr auto sha256() { return sha256_; }\n"
+      "      // if true, data is zlib stream\n"
+      "      constexpr auto compressed() { return compressed_; }\n"
       "    private:\n"
       "      std::string_view data_;\n"
+      "      size_t original_size_;\n"
+      "      unsigned long crc32_;\n"
+      "      std::string_view sha256_;\n"
+      "      bool compressed_;\n"
       "    }; // struct EmbeddedResource\n" ;
     for(const auto& f: infiles){
       embed_resources_h << "    static EmbeddedResource resource_"
@@ -123,24 +150,82 @@ int main(int argc, char** argv)
     }
     embed_resources_h <<
       "    else static_assert(filename._false(), \"Embedded resource filename not found\");\n"
-      "    return {{}};\n"
+      "    return {{}, 0, 0, {}, false};\n"
       "  }\n"
       "\n"
       "} // namespace embedded\n\n";
     embed_resources_h.close();
+    nw::ofstream embed_resources_s;
+    if(mode == "incbin") {
+      embed_resources_s.open( outdir / "embed_resources.S" );
+      if(!embed_resources_s.is_open())
+        throw std::runtime_error("Can't open file: embed_resources.S");
+      embed_resources_s <<
+        "#ifdef _WIN32\n"
+        "  .section .rdata,\"dr\"\n"
+        "#else\n"
+        "  .section .rodata\n"
+        "#endif\n\n" ;
+    }
     embed_resources_cpp <<
       "#include \"embed_resources.h\"\n"
       "\n"
       "namespace embedded {\n\n" ;
     for(const auto& f: infiles){
-      embed_resources_cpp << "  EmbeddedCollection::EmbeddedResource EmbeddedCollection::resource_"
-                          << prepare_name(f.filename().string()) << " = {\n    std::string_view(\n";
+      auto name = prepare_name(f.filename().string());
+      auto fsize = fs::file_size(f);
       nw::ifstream inf(f, std::ios::binary);
       if(!inf.is_open()) throw std::runtime_error("Can't open file: "+f.string());
-      auto fsize = fs::file_size(f);
       std::vector<unsigned char> data(fsize);
       inf.read(reinterpret_cast<char*>(data.data()), fsize);
       inf.close();
+      auto checksum = mz_crc32(MZ_CRC32_INIT, data.data(), data.size());
+      auto digest = sha256().update(data.data(), data.size()).hexdigest();
+      // resource is stored compressed, unless it is already compressed well (e.g. zip archive)
+      bool compressed = false;
+      if(!no_compress) {
+        mz_ulong zsize = mz_compressBound(fsize);
+        std::vector<unsigned char> zdata(zsize);
+        if(mz_compress2(zdata.data(), &zsize, data.data(), fsize, MZ_BEST_COMPRESSION) != MZ_OK)
+          throw std::runtime_error("Can't compress file: "+f.string());
+        compressed = zsize < fsize - fsize / 20;
+        if(compressed) {
+          zdata.resize(zsize);
+          data = std::move(zdata);
+        }
+      }
+      auto metadata = [&](){
+        return ", " + std::to_string(fsize) + ", " + std::to_string(checksum) + "ul, \"" + digest + "\", " + (compressed ? "true" : "false");
+      };
+      if(mode == "incbin") {
+        // assembler reads the file itself, so compiler doesn't have to parse its content
+        auto payload = fs::absolute(f);
+        if(compressed) {
+          payload = fs::absolute(outdir / (name + ".z"));
+          nw::ofstream outf(payload, std::ios::binary);
+          if(!outf.is_open() || !outf.write(reinterpret_cast<const char*>(data.data()), data.size()))
+            throw std::runtime_error("Can't write file: "+payload.string());
+        }
+        std::string escaped_path;
+        for(auto c: payload.generic_string()) {
+          if(c == '"' || c == '\\') escaped_path += '\\';
+          escaped_path += c;
+        }
+        embed_resources_s <<
+          "  .global embedded_resource_" << name << "\n"
+          "  .balign 16\n"
+          "embedded_resource_" << name << ":\n"
+          "  .incbin \"" << escaped_path << "\"\n"
+          "  .byte 0\n\n";
+        embed_resources_cpp <<
+          "  extern \"C\" const char embedded_resource_" << name << "[];\n"
+          "  EmbeddedCollection::EmbeddedResource EmbeddedCollection::resource_" << name
+                          << " = {\n    std::string_view(embedded_resource_" << name << ", " << data.size() << ")"
+                          << metadata() << "\n  };\n\n";
+        continue;
+      }
+      embed_resources_cpp << "  EmbeddedCollection::EmbeddedResource EmbeddedCollection::resource_"
+                          << name << " = {\n    std::string_view(\n";
       embed_resources_cpp << std::setfill('0') << std::setw(3) << std::oct ;
       unsigned ccount = 0;
       for(auto c: data){
@@ -152,10 +237,17 @@ int main(int argc, char** argv)
         }
       }
       if(ccount) embed_resources_cpp << "\"\n" ;
-      embed_resources_cpp << "      , " << std::dec << fsize << "\n    )\n  };\n\n";
+      embed_resources_cpp << "      , " << std::dec << data.size() << "\n    )" << metadata() << "\n  };\n\n";
     }
     embed_resources_cpp << "} // namespace embedded\n";
     embed_resources_cpp.close();
+    if(mode == "incbin") {
+      embed_resources_s <<
+        "#ifndef _WIN32\n"
+        "  .section .note.GNU-stack,\"\",@progbits\n"
+        "#endif\n" ;
+      embed_resources_s.close();
+    }
   }
   catch(const std::exception& e) {
     nw::cout << "Error: " << e.what() << '\n';
@@ -0,0 +1,280 @@
+#ifndef DOMPDFUI_HTTP_CLIENT_H
+#define DOMPDFUI_HTTP_CLIENT_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#ifdef DOMPDFUI_WITH_OPENSSL
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/ssl.hpp>
+#endif
+
+// parts of absolute http or https URL
+struct url_parts {
+  std::string scheme;   // lowercase "http" or "https"
+  std::string host;     // lowercase host name, without brackets for IPv6 address
+  std::string port;     // explicit port or default one of the scheme
+  std::string target;   // path and query, starting with '/'
+
+  // function split URL to parts, or return nothing if it isn't absolute http or https URL
+  static std::optional<url_parts> parse(std::string_view url)
+  {
+    url_parts r;
+    auto colon = url.find("://");
+    if(colon == url.npos) return {};
+    for(auto c: url.substr(0, colon)) r.scheme += std::tolower(static_cast<unsigned char>(c));
+    if(r.scheme != "http" && r.scheme != "https") return {};
+    auto rest = url.substr(colon + 3);
+    auto slash = rest.find_first_of("/?#");
+    auto authority = rest.substr(0, slash);
+    r.target = slash == rest.npos ? "/" : std::string(rest.substr(slash));
+    r.target = r.target.substr(0, r.target.find('#'));
+    if(r.target.empty() || r.target.front() != '/') r.target.insert(0, "/");
+    if(auto at = authority.rfind('@'); at != authority.npos) authority.remove_prefix(at + 1);
+    auto port_colon = authority.rfind(':');
+    if(port_colon != authority.npos && authority.find(']', port_colon) == authority.npos) {
+      r.port = authority.substr(port_colon + 1);
+      authority = authority.substr(0, port_colon);
+    }
+    if(authority.size() > 1 && authority.front() == '[' && authority.back() == ']') authority = authority.substr(1, authority.size() - 2);
+    for(auto c: authority) r.host += std::tolower(static_cast<unsigned char>(c));
+    if(r.host.empty()) return {};
+    if(r.port.empty()) r.port = r.scheme == "https" ? "443" : "80";
+    return r;
+  }
+
+  std::string str() const
+  {
+    auto h = host.find(':') == host.npos ? host : '[' + host + ']';
+    bool default_port = port == (scheme == "https" ? "443" : "80");
+    return scheme + "://" + h + (default_port ? "" : ':' + port) + target;
+  }
+};
+
+
+// function return absolute URL of reference relative to absolute base URL, or empty string if it can't be resolved
+inline std::string resolve_url(std::string_view base, std::string_view ref)
+{
+  if(url_parts::parse(ref)) return std::string(ref);
+  auto b = url_parts::parse(base);
+  if(!b) return {};
+  if(ref.starts_with("//")) return b->scheme + ':' + std::string(ref);
+  if(ref.empty() || ref.front() == '#') return b->str();
+  std::string path;
+  if(ref.front() == '/') {
+    path = ref;
+  } else if(ref.front() == '?') {
+    path = b->target.substr(0, b->target.find('?')) + std::string(ref);
+  } else {
+    auto dir = b->target.substr(0, b->target.find('?'));
+    path = dir.substr(0, dir.rfind('/') + 1) + std::string(ref);
+  }
+  // remove dot segments of path
+  auto query_pos = path.find('?');
+  auto query = query_pos == path.npos ? std::string() : path.substr(query_pos);
+  std::vector<std::string> segments;
+  std::string_view p(path.data(), query_pos == path.npos ? path.size() : query_pos);
+  bool trailing_slash = p.ends_with('/') || p.ends_with("/.") || p.ends_with("/..");
+  for(size_t pos = 1; pos <= p.size(); ) {
+    auto end = std::min(p.find('/', pos), p.size());
+    auto segment = p.substr(pos, end - pos);
+    if(segment == "..") {
+      if(!segments.empty()) segments.pop_back();
+    } else if(segment != "." && !segment.empty()) {
+      segments.emplace_back(segment);
+    }
+    pos = end + 1;
+  }
+  b->target.clear();
+  for(const auto& s: segments) b->target += '/' + s;
+  if(b->target.empty() || trailing_slash) b->target += '/';
+  b->target += query;
+  return b->str();
+}
+
+
+// response of HTTP GET request
+struct http_response {
+  unsigned status {};         // HTTP status code, or 0 if request failed
+  std::string error;          // description of failure
+  std::string url;            // URL of the response, after redirects
+  std::string body;
+  std::string etag, last_modified, cache_control, content_type;
+};
+
+
+// HTTP/1.1 client, which runs GET requests concurrently in one thread; redirects are followed
+// to allowed hosts only
+class http_client {
+public:
+  using headers_type = std::vector<std::pair<std::string, std::string>>;
+  using handler_type = std::function<void(http_response)>;
+  using host_predicate = std::function<bool(const std::string&)>;
+
+  explicit http_client(bool verify_peer, std::chrono::seconds timeout = std::chrono::seconds(30))
+    : timeout_(timeout)
+#ifdef DOMPDFUI_WITH_OPENSSL
+    , ssl_ctx_(boost::asio::ssl::context::tls_client)
+#endif
+  {
+#ifdef DOMPDFUI_WITH_OPENSSL
+    ssl_ctx_.set_default_verify_paths();
+    ssl_ctx_.set_verify_mode(verify_peer ? boost::asio::ssl::verify_peer : boost::asio::ssl::verify_none);
+#else
+    (void)verify_peer;
+#endif
+  }
+
+  // function return true, if requests with given URL scheme can be made
+  static bool supports(std::string_view scheme)
+  {
+#ifdef DOMPDFUI_WITH_OPENSSL
+    return scheme == "http" || scheme == "https";
+#else
+    return scheme == "http";
+#endif
+  }
+
+  // function set predicate, which is given lowercase host of each request and of each redirect;
+  // requests to hosts, for which it returns false, fail without connection
+  void allow_hosts(host_predicate allowed)
+  {
+    allowed_ = std::move(allowed);
+  }
+
+  // function queue request; handler is called by run(), and may queue further requests
+  void get(std::string url, headers_type headers, handler_type handler)
+  {
+    queue_.push_back({std::move(url), std::move(headers), std::move(handler)});
+  }
+
+  // function run queued requests, at most max_connections at the same time, until the queue is empty
+  void run(size_t max_connections)
+  {
+    for(size_t i=0; i<std::max<size_t>(1, max_connections); ++i) {
+      boost::asio::co_spawn(ioc_, worker(), boost::asio::detached);
+    }
+    ioc_.run();
+    ioc_.restart();
+  }
+
+private:
+  struct request {
+    std::string url;
+    headers_type headers;
+    handler_type handler;
+  };
+
+  boost::asio::awaitable<void> worker()
+  {
+    while(!queue_.empty()) {
+      auto r = std::move(queue_.front());
+      queue_.pop_front();
+      auto response = co_await fetch(r.url, r.headers);
+      r.handler(std::move(response));
+    }
+  }
+
+  boost::asio::awaitable<http_response> fetch(std::string url, const headers_type& headers)
+  {
+    http_response r;
+    for(int redirects = 0; ; ++redirects) {
+      auto parts = url_parts::parse(url);
+      if(!parts || !supports(parts->scheme)) {
+        r.error = "unsupported URL " + url;
+        co_return r;
+      }
+      if(allowed_ && !allowed_(parts->host)) {
+        r = {};
+        r.error = "host isn't allowed " + url;
+        co_return r;
+      }
+      std::string location;
+      try {
+        r = co_await fetch_once(*parts, headers, location);
+      }
+      catch(const std::exception& e) {
+        r = {};
+        r.error = url + ": " + e.what();
+      }
+      r.url = url;
+      if(location.empty() || r.status < 300 || r.status > 308 || r.status == 304) co_return r;
+      if(redirects == 5) {
+        r.status = 0;
+        r.error = "too many redirects " + url;
+        co_return r;
+      }
+      url = resolve_url(url, location);
+    }
+  }
+
+  boost::asio::awaitable<http_response> fetch_once(const url_parts& u, const headers_type& headers, std::string& location)
+  {
+    namespace http = boost::beast::http;
+    auto executor = co_await boost::asio::this_coro::executor;
+    boost::asio::ip::tcp::resolver resolver(executor);
+    auto endpoints = co_await resolver.async_resolve(u.host, u.port, boost::asio::use_awaitable);
+
+    http::request<http::empty_body> req { http::verb::get, u.target, 11 };
+    req.set(http::field::host, u.host);
+    req.set(http::field::user_agent, "dompdfui");
+    req.set(http::field::connection, "close");
+    for(const auto& [name, value]: headers) req.set(name, value);
+
+    boost::beast::flat_buffer buffer;
+    http::response_parser<http::string_body> parser;
+    parser.body_limit(max_body_size);
+    boost::beast::tcp_stream tcp(executor);
+    tcp.expires_after(timeout_);
+    co_await tcp.async_connect(endpoints, boost::asio::use_awaitable);
+    if(u.scheme == "https") {
+#ifdef DOMPDFUI_WITH_OPENSSL
+      boost::beast::ssl_stream<boost::beast::tcp_stream> stream(std::move(tcp), ssl_ctx_);
+      SSL_set_tlsext_host_name(stream.native_handle(), u.host.c_str());
+      SSL_set1_host(stream.native_handle(), u.host.c_str());
+      co_await stream.async_handshake(boost::asio::ssl::stream_base::client, boost::asio::use_awaitable);
+      co_await http::async_write(stream, req, boost::asio::use_awaitable);
+      co_await http::async_read(stream, buffer, parser, boost::asio::use_awaitable);
+#endif
+    } else {
+      co_await http::async_write(tcp, req, boost::asio::use_awaitable);
+      co_await http::async_read(tcp, buffer, parser, boost::asio::use_awaitable);
+    }
+    auto& res = parser.get();
+    http_response r;
+    r.status = res.result_int();
+    auto field = [&res](http::field f){
+      auto v = res[f];
+      return std::string(v.data(), v.size());
+    };
+    r.etag = field(http::field::etag);
+    r.last_modified = field(http::field::last_modified);
+    r.cache_control = field(http::field::cache_control);
+    r.content_type = field(http::field::content_type);
+    location = field(http::field::location);
+    r.body = std::move(res.body());
+    co_return r;
+  }
+
+  static constexpr size_t max_body_size = 64 << 20;
+
+  boost::asio::io_context ioc_;
+  std::deque<request> queue_;
+  std::chrono::seconds timeout_;
+  host_predicate allowed_;
+#ifdef DOMPDFUI_WITH_OPENSSL
+  boost::asio::ssl::context ssl_ctx_;
+#endif
+};
+
+#endif // DOMPDFUI_HTTP_CLIENT_H
@@ -0,0 +1,608 @@
+#ifndef DOMPDFUI_PDF_MERGE_H
+#define DOMPDFUI_PDF_MERGE_H
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "sha256.h"
+
+// value of PDF object; dictionary items are keys (names) followed by their values
+struct pdf_value {
+  enum kind_type { null, token, name, string, array, dict, ref };
+  kind_type kind {null};
+  std::string text;               // token (number or boolean), name without '/', or string with its delimiters
+  std::vector<pdf_value> items;   // items of array or dictionary
+  unsigned num {}, gen {};        // reference
+
+  const pdf_value* find(std::string_view key) const
+  {
+    if(kind != dict) return nullptr;
+    for(size_t i=0; i+1<items.size(); i+=2) if(items[i].text == key) return &items[i + 1];
+    return nullptr;
+  }
+
+  void set(std::string_view key, pdf_value value)
+  {
+    for(size_t i=0; i+1<items.size(); i+=2) {
+      if(items[i].text == key) {
+        items[i + 1] = std::move(value);
+        return;
+      }
+    }
+    items.push_back(make_name(std::string(key)));
+    items.push_back(std::move(value));
+  }
+
+  static pdf_value make_name(std::string n) { pdf_value v; v.kind = name; v.text = std::move(n); return v; }
+  static pdf_value make_token(std::string t) { pdf_value v; v.kind = token; v.text = std::move(t); return v; }
+  static pdf_value make_ref(unsigned n) { pdf_value v; v.kind = ref; v.num = n; return v; }
+  static pdf_value make_array() { pdf_value v; v.kind = array; return v; }
+  static pdf_value make_dict() { pdf_value v; v.kind = dict; return v; }
+
+  void write(std::string& out) const
+  {
+    switch(kind) {
+    case null: out += "null"; break;
+    case token: out += text; break;
+    case name: out += '/'; out += text; break;
+    case string: out += text; break;
+    case ref: out += std::to_string(num) + ' ' + std::to_string(gen) + " R"; break;
+    case array:
+      out += '[';
+      for(size_t i=0; i<items.size(); ++i) {
+        if(i) out += ' ';
+        items[i].write(out);
+      }
+      out += ']';
+      break;
+    case dict:
+      out += "<<";
+      for(size_t i=0; i+1<items.size(); i+=2) {
+        items[i].write(out);
+        out += ' ';
+        items[i + 1].write(out);
+        out += '\n';
+      }
+      out += ">>";
+      break;
+    }
+  }
+};
+
+
+// reader of PDF file with classic cross-reference table, as written by Dompdf's CPDF backend
+class pdf_reader {
+public:
+  // indirect object, and data of its stream, if it is a stream
+  struct object {
+    pdf_value value;
+    std::optional<std::string_view> stream;
+  };
+
+  explicit pdf_reader(std::string_view data) : data_(data)
+  {
+    if(!data_.starts_with("%PDF-")) throw std::runtime_error("not a PDF file");
+    version_ = data_.substr(5, data_.find_first_of("\r\n") - 5);
+    auto startxref = data_.rfind("startxref");
+    if(startxref == data_.npos) throw std::runtime_error("PDF cross-reference table isn't found");
+    size_t pos = startxref + 9;
+    std::set<size_t> visited;
+    for(auto offset = std::strtoull(std::string(token(pos)).c_str(), nullptr, 10); ; ) {
+      if(!visited.insert(offset).second) break;
+      auto prev = read_xref(offset);
+      if(!prev) break;
+      offset = *prev;
+    }
+    if(trailer_.find("Encrypt")) throw std::runtime_error("encrypted PDF can't be merged");
+  }
+
+  const std::string& version() const { return version_; }
+  const pdf_value& trailer() const { return trailer_; }
+
+  // function return indirect object with given number
+  object get(unsigned num) const
+  {
+    auto it = offsets_.find(num);
+    if(it == offsets_.end()) return {};
+    size_t pos = it->second;
+    token(pos);
+    token(pos);
+    if(token(pos) != "obj") throw std::runtime_error("PDF object " + std::to_string(num) + " isn't found");
+    object r { parse(pos), {} };
+    skip_space(pos);
+    if(data_.compare(pos, 6, "stream") == 0) {
+      pos += 6;
+      if(data_.compare(pos, 2, "\r\n") == 0) pos += 2;
+      else if(pos < data_.size() && data_[pos] == '\n') ++pos;
+      long long length = -1;
+      if(auto l = r.value.find("Length")) {
+        if(l->kind == pdf_value::token) length = std::atoll(l->text.c_str());
+        else if(l->kind == pdf_value::ref && l->num != num) length = std::atoll(get(l->num).value.text.c_str());
+      }
+      size_t end = length >= 0 && pos + length <= data_.size() ? pos + length : data_.npos;
+      auto after = end;
+      if(end != data_.npos) skip_space(after);
+      if(end == data_.npos || data_.compare(after, 9, "endstream") != 0) {
+        // wrong length: stream ends at "endstream" without end of line before it
+        end = data_.find("endstream", pos);
+        if(end == data_.npos) throw std::runtime_error("PDF stream " + std::to_string(num) + " isn't terminated");
+        if(end > pos && data_[end - 1] == '\n') --end;
+        if(end > pos && data_[end - 1] == '\r') --end;
+      }
+      r.stream = data_.substr(pos, end - pos);
+    }
+    return r;
+  }
+
+  // function return value, resolving indirect reference
+  pdf_value resolve(const pdf_value& v) const
+  {
+    return v.kind == pdf_value::ref ? get(v.num).value : v;
+  }
+
+private:
+  static bool is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0'; }
+  static bool is_delimiter(char c) { return std::strchr("()<>[]{}/%", c) != nullptr; }
+
+  void skip_space(size_t& pos) const
+  {
+    while(pos < data_.size()) {
+      if(data_[pos] == '%') {
+        pos = data_.find_first_of("\r\n", pos);
+        if(pos == data_.npos) pos = data_.size();
+      } else if(is_space(data_[pos])) {
+        ++pos;
+      } else {
+        break;
+      }
+    }
+  }
+
+  std::string_view token(size_t& pos) const
+  {
+    skip_space(pos);
+    auto begin = pos;
+    while(pos < data_.size() && !is_space(data_[pos]) && !is_delimiter(data_[pos])) ++pos;
+    return data_.substr(begin, pos - begin);
+  }
+
+  static bool is_integer(std::string_view t)
+  {
+    return !t.empty() && t.find_first_not_of("0123456789") == t.npos;
+  }
+
+  pdf_value parse(size_t& pos, int depth = 0) const
+  {
+    if(depth > 256) throw std::runtime_error("PDF object is nested too deep");
+    skip_space(pos);
+    if(pos >= data_.size()) throw std::runtime_error("unexpected end of PDF file");
+    pdf_value v;
+    auto c = data_[pos];
+    if(data_.compare(pos, 2, "<<") == 0) {
+      v.kind = pdf_value::dict;
+      pos += 2;
+      for(;;) {
+        skip_space(pos);
+        if(pos >= data_.size()) throw std::runtime_error("unexpected end of PDF file");
+        if(data_.compare(pos, 2, ">>") == 0) {
+          pos += 2;
+          break;
+        }
+        auto key = parse(pos, depth + 1);
+        if(key.kind != pdf_value::name) throw std::runtime_error("PDF dictionary key isn't a name");
+        v.items.push_back(std::move(key));
+        v.items.push_back(parse(pos, depth + 1));
+      }
+    } else if(c == '<') {
+      auto end = data_.find('>', pos);
+      if(end == data_.npos) throw std::runtime_error("unexpected end of PDF file");
+      v.kind = pdf_value::string;
+      v.text = data_.substr(pos, end + 1 - pos);
+      pos = end + 1;
+    } else if(c == '(') {
+      auto begin = pos;
+      int level = 0;
+      for(; pos < data_.size(); ++pos) {
+        if(data_[pos] == '\\') ++pos;
+        else if(data_[pos] == '(') ++level;
+        else if(data_[pos] == ')' && --level == 0) break;
+      }
+      if(pos >= data_.size()) throw std::runtime_error("unexpected end of PDF file");
+      v.kind = pdf_value::string;
+      v.text = data_.substr(begin, ++pos - begin);
+    } else if(c == '[') {
+      v.kind = pdf_value::array;
+      ++pos;
+      for(;;) {
+        skip_space(pos);
+        if(pos >= data_.size()) throw std::runtime_error("unexpected end of PDF file");
+        if(data_[pos] == ']') {
+          ++pos;
+          break;
+        }
+        v.items.push_back(parse(pos, depth + 1));
+      }
+    } else if(c == '/') {
+      ++pos;
+      v.kind = pdf_value::name;
+      v.text = token(pos);
+    } else {
+      auto t = token(pos);
+      if(t.empty()) throw std::runtime_error("unexpected character in PDF file");
+      if(t == "null") return v;
+      v.kind = pdf_value::token;
+      v.text = t;
+      // "NUM GEN R" is reference
+      auto next = pos;
+      if(is_integer(t)) {
+        auto gen = token(next);
+        if(is_integer(gen) && token(next) == "R") {
+          v.kind = pdf_value::ref;
+          v.num = std::strtoul(std::string(t).c_str(), nullptr, 10);
+          v.gen = std::strtoul(std::string(gen).c_str(), nullptr, 10);
+          v.text.clear();
+          pos = next;
+        }
+      }
+    }
+    return v;
+  }
+
+  // function read cross-reference section at offset, and return offset of previous one
+  std::optional<size_t> read_xref(size_t pos)
+  {
+    if(pos >= data_.size() || token(pos) != "xref") throw std::runtime_error("unsupported PDF cross-reference stream");
+    for(;;) {
+      auto first = token(pos);
+      if(first == "trailer") break;
+      auto count = token(pos);
+      if(!is_integer(first) || !is_integer(count)) throw std::runtime_error("broken PDF cross-reference table");
+      auto num = std::strtoul(std::string(first).c_str(), nullptr, 10);
+      for(unsigned long i=0, n=std::strtoul(std::string(count).c_str(), nullptr, 10); i<n; ++i) {
+        auto offset = token(pos);
+        token(pos);
+        auto type = token(pos);
+        // sections read later are older, so entries read first are kept
+        if(type == "n") offsets_.try_emplace(num + i, std::strtoull(std::string(offset).c_str(), nullptr, 10));
+      }
+    }
+    auto trailer = parse(pos);
+    // objects of hybrid file may be listed only in its cross-reference stream
+    if(trailer.find("XRefStm")) throw std::runtime_error("unsupported PDF cross-reference stream");
+    if(trailer_.kind == pdf_value::null) trailer_ = trailer;
+    auto prev = trailer.find("Prev");
+    if(!prev || prev->kind != pdf_value::token) return {};
+    return std::strtoull(prev->text.c_str(), nullptr, 10);
+  }
+
+  std::string_view data_;
+  std::string version_;
+  pdf_value trailer_;
+  std::unordered_map<unsigned, size_t> offsets_;
+};
+
+
+// merger of PDF files, e.g. parts of document rendered separately: pages of appended files follow each other,
+// and objects with the same bytes in several files, like images and fonts that aren't subset, are written once.
+// Named destinations of all files are kept, both /Dests dictionary and /Dests name tree, and entries of document
+// catalog which describe the whole document (metadata, output intents, viewer settings) are taken from the first
+// file; other entries of catalog, like outlines, other name trees and forms, can't be combined, and appending
+// a file which has them fails
+class pdf_merger {
+public:
+  // function append pages of PDF file
+  void append(std::string_view data)
+  {
+    pdf_reader in(data);
+    auto root = in.resolve(required(in.trailer(), "Root"));
+    for(size_t i=0; i+1<root.items.size(); i+=2) {
+      const auto& key = root.items[i].text;
+      if(key == "Type" || key == "Pages" || key == "Dests" || document_keys().contains(key)) continue;
+      if(key == "Outlines" && empty_outlines(in, in.resolve(root.items[i + 1]))) continue;
+      if(key == "Names") {
+        auto names = in.resolve(root.items[i + 1]);
+        for(size_t j=0; j+1<names.items.size(); j+=2) {
+          if(names.items[j].text != "Dests") throw std::runtime_error("PDF name tree /" + names.items[j].text + " can't be merged");
+        }
+        continue;
+      }
+      throw std::runtime_error("PDF catalog entry /" + key + " can't be merged");
+    }
+    bool first = kids_.empty();
+    if(version_.empty() || version_ < in.version()) version_ = in.version();
+    numbers_.clear();
+    std::vector<std::pair<unsigned, pdf_value>> pages;
+    std::set<unsigned> visited;
+    collect_pages(in, required(root, "Pages"), pdf_value{}, pages, visited, 0);
+    // pages are numbered first, so that references to them (e.g. from links) don't copy the page tree
+    for(auto& [num, page]: pages) numbers_[num] = { allocate(), true };
+    for(auto& [num, page]: pages) {
+      page.set("Parent", pdf_value{});
+      bool pending = false;
+      renumber(in, page, pending);
+      page.set("Parent", pdf_value::make_ref(pages_num_));
+      auto n = numbers_[num].num;
+      page.write(objects_[n - 1]);
+      kids_.push_back(n);
+    }
+    // destination of a name is taken from the first file, which has it
+    if(auto dests = root.find("Dests")) {
+      auto d = in.resolve(*dests);
+      for(size_t i=0; i+1<d.items.size(); i+=2) {
+        if(dests_.find(d.items[i].text)) continue;
+        auto dest = d.items[i + 1];
+        bool pending = false;
+        renumber(in, dest, pending);
+        dests_.set(d.items[i].text, std::move(dest));
+      }
+    }
+    if(auto names = root.find("Names")) {
+      auto n = in.resolve(*names);
+      if(auto dests = n.find("Dests")) collect_names(in, *dests, 0);
+    }
+    if(first) {
+      for(size_t i=0; i+1<root.items.size(); i+=2) {
+        if(!document_keys().contains(root.items[i].text)) continue;
+        auto value = root.items[i + 1];
+        bool pending = false;
+        renumber(in, value, pending);
+        catalog_.set(root.items[i].text, std::move(value));
+      }
+    }
+    if(!info_) {
+      if(auto info = in.trailer().find("Info"); info && info->kind == pdf_value::ref) {
+        bool pending = false;
+        info_ = copy(in, info->num, pending);
+      }
+    }
+  }
+
+  // function return merged PDF file
+  std::string str() const
+  {
+    if(kids_.empty()) throw std::runtime_error("merged PDF has no pages");
+    std::string out = "%PDF-" + (version_.empty() ? std::string("1.7") : version_) + "\n%\xe2\xe3\xcf\xd3\n";
+    std::vector<size_t> offsets(objects_.size() + 2);
+    auto write_object = [&](unsigned n, std::string_view content){
+      offsets[n] = out.size();
+      out += std::to_string(n) + " 0 obj\n";
+      out += content;
+      out += "\nendobj\n";
+    };
+    std::string kids;
+    for(auto k: kids_) kids += (kids.empty() ? "" : " ") + std::to_string(k) + " 0 R";
+    for(size_t i=0; i<objects_.size(); ++i) {
+      if(i + 1 == pages_num_) write_object(pages_num_, "<</Type /Pages\n/Kids [" + kids + "]\n/Count " + std::to_string(kids_.size()) + "\n>>");
+      else write_object(i + 1, objects_[i]);
+    }
+    auto catalog_num = unsigned(objects_.size() + 1);
+    auto catalog = pdf_value::make_dict();
+    catalog.set("Type", pdf_value::make_name("Catalog"));
+    catalog.set("Pages", pdf_value::make_ref(pages_num_));
+    if(!dests_.items.empty()) catalog.set("Dests", dests_);
+    if(!name_dests_.empty()) {
+      // name tree of one leaf, with keys in order of their bytes
+      auto leaf = pdf_value::make_array(), tree = pdf_value::make_dict(), names = pdf_value::make_dict();
+      for(const auto& [bytes, entry]: name_dests_) {
+        leaf.items.push_back(entry.first);
+        leaf.items.push_back(entry.second);
+      }
+      tree.set("Names", std::move(leaf));
+      names.set("Dests", std::move(tree));
+      catalog.set("Names", std::move(names));
+    }
+    for(size_t i=0; i+1<catalog_.items.size(); i+=2) catalog.set(catalog_.items[i].text, catalog_.items[i + 1]);
+    std::string content;
+    catalog.write(content);
+    write_object(catalog_num, content);
+    auto xref = out.size();
+    out += "xref\n0 " + std::to_string(catalog_num + 1) + "\n0000000000 65535 f \n";
+    char entry[32];
+    for(unsigned n=1; n<=catalog_num; ++n) {
+      std::snprintf(entry, sizeof(entry), "%010llu 00000 n \n", static_cast<unsigned long long>(offsets[n]));
+      out += entry;
+    }
+    auto id = sha256().update(out).hexdigest().substr(0, 32);
+    out += "trailer\n<</Size " + std::to_string(catalog_num + 1) + "\n/Root " + std::to_string(catalog_num) + " 0 R\n";
+    if(info_) out += "/Info " + std::to_string(*info_) + " 0 R\n";
+    out += "/ID [<" + id + "> <" + id + ">]\n>>\nstartxref\n" + std::to_string(xref) + "\n%%EOF\n";
+    return out;
+  }
+
+  size_t pages() const { return kids_.size(); }
+  size_t shared_objects() const { return shared_count_; }
+
+private:
+  struct number {
+    unsigned num {};   // number in output, or 0 if it isn't given yet
+    bool done {};
+  };
+
+  static const pdf_value& required(const pdf_value& dict, std::string_view key)
+  {
+    auto v = dict.find(key);
+    if(!v) throw std::runtime_error("PDF dictionary hasn't required key " + std::string(key));
+    return *v;
+  }
+
+  // entries of catalog, which are about the whole document and are the same in its parts
+  static const std::set<std::string, std::less<>>& document_keys()
+  {
+    static const std::set<std::string, std::less<>> keys {
+      "Metadata", "OutputIntents", "MarkInfo", "Lang", "ViewerPreferences", "PageMode", "PageLayout" };
+    return keys;
+  }
+
+  // function check that outline tree has no items; Dompdf's CPDF backend writes an empty one to every file
+  static bool empty_outlines(const pdf_reader& in, const pdf_value& outlines)
+  {
+    if(outlines.kind != pdf_value::dict) return outlines.kind == pdf_value::null;
+    auto count = outlines.find("Count");
+    auto kids = outlines.find("Kids");
+    return !outlines.find("First") && (!count || count->text == "0") && (!kids || in.resolve(*kids).items.empty());
+  }
+
+  // function return bytes of PDF string with its delimiters, literal or hexadecimal, to order keys of name tree
+  static std::string string_bytes(std::string_view s)
+  {
+    std::string r;
+    if(s.size() < 2) return r;
+    bool hex = s.front() == '<';
+    s = s.substr(1, s.size() - 2);
+    if(hex) {
+      std::string digits;
+      for(char c: s) if(std::isxdigit(static_cast<unsigned char>(c))) digits += c;
+      if(digits.size() % 2) digits += '0';
+      for(size_t i=0; i<digits.size(); i+=2) r += char(std::stoi(digits.substr(i, 2), nullptr, 16));
+      return r;
+    }
+    for(size_t i=0; i<s.size(); ++i) {
+      if(s[i] != '\\' || i + 1 == s.size()) {
+        r += s[i];
+        continue;
+      }
+      char c = s[++i];
+      if(c >= '0' && c <= '7') {
+        int v = 0;
+        for(int k=0; k<3 && i<s.size() && s[i] >= '0' && s[i] <= '7'; ++k, ++i) v = v * 8 + (s[i] - '0');
+        r += char(v);
+        --i;
+      }
+      else if(c == 'n') r += '\n';
+      else if(c == 'r') r += '\r';
+      else if(c == 't') r += '\t';
+      else if(c == 'b') r += '\b';
+      else if(c == 'f') r += '\f';
+      else if(c == '\r') { if(i + 1 < s.size() && s[i + 1] == '\n') ++i; }
+      else if(c != '\n') r += c;
+    }
+    return r;
+  }
+
+  // function collect named destinations of name tree; destination of a name is taken from the first file,
+  // which has it
+  void collect_names(const pdf_reader& in, const pdf_value& node_ref, int depth)
+  {
+    if(depth > 64) throw std::runtime_error("PDF name tree is too deep");
+    auto node = in.resolve(node_ref);
+    if(auto names = node.find("Names")) {
+      auto n = in.resolve(*names);
+      for(size_t i=0; i+1<n.items.size(); i+=2) {
+        if(n.items[i].kind != pdf_value::string) continue;
+        auto bytes = string_bytes(n.items[i].text);
+        if(name_dests_.contains(bytes)) continue;
+        auto dest = n.items[i + 1];
+        bool pending = false;
+        renumber(in, dest, pending);
+        name_dests_.emplace(std::move(bytes), std::make_pair(n.items[i], std::move(dest)));
+      }
+    }
+    if(auto kids = node.find("Kids")) {
+      for(const auto& kid: in.resolve(*kids).items) collect_names(in, kid, depth + 1);
+    }
+  }
+
+  unsigned allocate()
+  {
+    if(!pages_num_) {
+      objects_.emplace_back();
+      pages_num_ = unsigned(objects_.size());
+    }
+    objects_.emplace_back();
+    return unsigned(objects_.size());
+  }
+
+  // function collect pages of page tree in order, with attributes inherited from their ancestors
+  void collect_pages(const pdf_reader& in, const pdf_value& node_ref, pdf_value inherited,
+                     std::vector<std::pair<unsigned, pdf_value>>& pages, std::set<unsigned>& visited, int depth)
+  {
+    if(node_ref.kind != pdf_value::ref || !visited.insert(node_ref.num).second || depth > 64) return;
+    auto node = in.get(node_ref.num).value;
+    if(inherited.kind == pdf_value::null) inherited.kind = pdf_value::dict;
+    for(auto key: { "Resources", "MediaBox", "CropBox", "Rotate" }) {
+      if(auto v = node.find(key)) inherited.set(key, *v);
+    }
+    auto type = node.find("Type");
+    if(auto kids = node.find("Kids"); kids && !(type && type->text == "Page")) {
+      auto k = in.resolve(*kids);
+      for(const auto& kid: k.items) collect_pages(in, kid, inherited, pages, visited, depth + 1);
+      return;
+    }
+    for(size_t i=0; i+1<inherited.items.size(); i+=2) node.set(inherited.items[i].text, inherited.items[i + 1]);
+    pages.emplace_back(node_ref.num, std::move(node));
+  }
+
+  // function replace references in value by numbers of copied objects
+  void renumber(const pdf_reader& in, pdf_value& v, bool& pending)
+  {
+    if(v.kind == pdf_value::ref) {
+      v.num = copy(in, v.num, pending);
+      v.gen = 0;
+    }
+    for(auto& e: v.items) renumber(in, e, pending);
+  }
+
+  // function copy object with objects it references, and return its number in output; objects are shared
+  // with earlier ones of the same content, unless they reference objects being copied (i.e. form a cycle),
+  // in which case pending is set and they are written as they are
+  unsigned copy(const pdf_reader& in, unsigned num, bool& pending)
+  {
+    if(auto it = numbers_.find(num); it != numbers_.end()) {
+      if(!it->second.done) {
+        pending = true;
+        if(!it->second.num) it->second.num = allocate();
+      }
+      return it->second.num;
+    }
+    numbers_[num] = {};
+    auto obj = in.get(num);
+    bool own_pending = false;
+    if(obj.stream) obj.value.set("Length", pdf_value::make_token(std::to_string(obj.stream->size())));
+    renumber(in, obj.value, own_pending);
+    std::string content;
+    obj.value.write(content);
+    if(obj.stream) {
+      content += "\nstream\n";
+      content += *obj.stream;
+      content += "\nendstream";
+    }
+    auto& n = numbers_[num];
+    n.done = true;
+    pending |= own_pending;
+    if(!own_pending && !n.num) {
+      auto key = sha256().update(content).hexdigest();
+      if(auto s = shared_.find(key); s != shared_.end()) {
+        ++shared_count_;
+        return n.num = s->second;
+      }
+      n.num = allocate();
+      shared_.emplace(key, n.num);
+    }
+    if(!n.num) n.num = allocate();
+    objects_[n.num - 1] = std::move(content);
+    return n.num;
+  }
+
+  std::string version_;
+  std::vector<std::string> objects_;              // content of objects, numbered from 1
+  unsigned pages_num_ {};                         // number of root of page tree
+  std::vector<unsigned> kids_;                    // numbers of pages
+  std::optional<unsigned> info_;
+  pdf_value dests_ = pdf_value::make_dict();      // named destinations of all files
+  std::map<std::string, std::pair<pdf_value, pdf_value>> name_dests_;  // bytes of name => name, destination
+  pdf_value catalog_ = pdf_value::make_dict();    // entries of catalog taken from the first file
+  std::map<unsigned, number> numbers_;            // numbers of objects of file being appended
+  std::unordered_map<std::string, unsigned> shared_;  // hash of content => number
+  size_t shared_count_ {};
+};
+
+#endif // DOMPDFUI_PDF_MERGE_H
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Convert a document, which references a style sheet and images served by local HTTP server, with --asset-cache
+# twice: the first run must download all assets, and the second one revalidate them by conditional requests,
+# which the server answers with 304. With --image-cache the downloaded image must be optimized by the first run,
+# and taken from the image cache by the second one. A third run with --allowedRemoteHosts must not follow
+# a redirect of an allowed host to another one.
+# Usage: test_assets.py DOMPDFUI WORK_DIR [--image-cache]
+
+import http.server
+import shutil
+import struct
+import subprocess
+import sys
+import threading
+import zlib
+from pathlib import Path
+
+
+# function return opaque RGB PNG image of given size
+def png(width, height):
+    def chunk(kind, data):
+        return struct.pack('>I', len(data)) + kind + data + struct.pack('>I', zlib.crc32(kind + data))
+    rows = b''.join(b'\0' + bytes(c for x in range(width) for c in (x * 255 // width, y * 255 // height, (x ^ y) & 255))
+                    for y in range(height))
+    return (b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0))
+            + chunk(b'IDAT', zlib.compress(rows)) + chunk(b'IEND', b''))
+
+
+dompdfui, work_dir = sys.argv[1], Path(sys.argv[2])
+image_cache = '--image-cache' in sys.argv[3:]
+shutil.rmtree(work_dir, ignore_errors=True)
+site = work_dir / 'site'
+site.mkdir(parents=True)
+(site / 'style.css').write_text('body { background: url(background.png); }\n')
+(site / 'background.png').write_bytes(png(8, 8))
+(site / 'photo.png').write_bytes(png(400, 300))
+
+requests = []
+class Handler(http.server.SimpleHTTPRequestHandler):
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, directory=str(site), **kwargs)
+    def log_request(self, code='-', size='-'):
+        requests.append((self.path, int(code)))
+    def do_GET(self):
+        if self.path != '/moved.png':
+            return super().do_GET()
+        self.send_response(302)
+        self.send_header('Location', 'http://localhost:%d/photo.png' % server.server_address[1])
+        self.send_header('Content-Length', '0')
+        self.end_headers()
+
+server = http.server.ThreadingHTTPServer(('127.0.0.1', 0), Handler)
+threading.Thread(target=server.serve_forever, daemon=True).start()
+base = 'http://127.0.0.1:%d' % server.server_address[1]
+document = work_dir / 'assets.html'
+document.write_text('<html><head><link rel="stylesheet" href="%s/style.css"></head>\n'
+                    '<body><p>Assets</p><img src="%s/photo.png" width="40" height="30"></body></html>\n' % (base, base))
+
+
+# function convert the document and return output of the program and requests received by the server
+def convert(doc=document, extra_args=[]):
+    requests.clear()
+    args = [dompdfui, '--no-clean', '--force-out', '--isRemoteEnabled=1', '--asset-cache', str(work_dir / 'assets')]
+    if image_cache:
+        args += ['--image-cache', str(work_dir / 'images')]
+    r = subprocess.run(args + extra_args + [str(doc), str(work_dir / 'out')], capture_output=True, text=True)
+    if r.returncode:
+        sys.exit('dompdfui failed:\n' + r.stdout + r.stderr)
+    return r.stdout, sorted(requests)
+
+
+def check(condition, message, output):
+    if not condition:
+        sys.exit(message + ':\n' + output)
+
+
+assets = sorted(['/style.css', '/background.png', '/photo.png'])
+output, received = convert()
+check('Asset cache: 3 downloaded, 0 revalidated, 0 fresh, 0 failed' in output, 'first run must download all assets', output)
+check(received == [(path, 200) for path in assets], 'unexpected requests of first run: %s' % received, output)
+check(not image_cache or 'Image cache: 1 optimized' in output, 'first run must optimize the image', output)
+# opaque PNG must stay lossless
+check(not image_cache or [p.suffix for p in (work_dir / 'images').rglob('*.*')] == ['.png'],
+      'optimized image must be PNG', output)
+
+output, received = convert()
+check('Asset cache: 0 downloaded, 3 revalidated, 0 fresh, 0 failed' in output, 'second run must revalidate all assets', output)
+check(received == [(path, 304) for path in assets], 'unexpected requests of second run: %s' % received, output)
+check(not image_cache or 'Image cache: 0 optimized' in output and '1 cached' in output,
+      'second run must take the image from cache', output)
+
+redirected = work_dir / 'redirected.html'
+redirected.write_text('<html><body><img src="%s/moved.png" width="40" height="30"></body></html>\n' % base)
+output, _ = convert(redirected, ['--allowedRemoteHosts', '127.0.0.1'])
+check('Asset cache: 0 downloaded, 0 revalidated, 0 fresh, 1 failed' in output, 'redirect to another host must fail', output)
+server.shutdown()
@@ -0,0 +1,61 @@
+# Convert a document with a local style sheet by --cache-dir four times: the second run must copy it
+# from the output cache, the third one, which changes a Dompdf option, and the fourth one, which follows
+# a change of the style sheet, must convert it again.
+# Variables: DOMPDFUI - path to executable, WORK_DIR - directory of test
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}/in")
+file(WRITE "${WORK_DIR}/in/cache.html"
+  "<html><head><link href=\"cache.css\" rel=\"stylesheet\"/></head><body><p>Output cache</p></body></html>\n")
+file(WRITE "${WORK_DIR}/in/cache.css" "p { color: black; }\n")
+set(REPORT "${WORK_DIR}/report.jsonl")
+
+# function convert the document and return its status from report and counters of the output cache
+# printed by the program; further arguments are options
+function(run_cache STATUS_OUT COUNTERS_OUT)
+  file(REMOVE "${REPORT}")
+  execute_process(
+    COMMAND "${DOMPDFUI}" --no-clean --force-out --cache-dir "${WORK_DIR}/cache" --report "${REPORT}" ${ARGN}
+            "${WORK_DIR}/in/cache.html" "${WORK_DIR}/out"
+    RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "dompdfui failed\n${OUTPUT}")
+  endif()
+  file(STRINGS "${REPORT}" LINES)
+  set(STATUS "")
+  foreach(LINE ${LINES})
+    string(JSON TYPE GET "${LINE}" "type")
+    if(TYPE STREQUAL "document")
+      string(JSON STATUS GET "${LINE}" "status")
+    endif()
+  endforeach()
+  string(REGEX MATCH "Output cache: [0-9]+ hits, [0-9]+ misses" COUNTERS "${OUTPUT}")
+  set(${STATUS_OUT} "${STATUS}" PARENT_SCOPE)
+  set(${COUNTERS_OUT} "${COUNTERS}" PARENT_SCOPE)
+endfunction()
+
+# function check status and cache counters of a run
+function(check_run NAME STATUS COUNTERS EXPECTED_STATUS EXPECTED_HITS)
+  math(EXPR MISSES "1 - ${EXPECTED_HITS}")
+  if(NOT STATUS STREQUAL EXPECTED_STATUS OR NOT COUNTERS STREQUAL "Output cache: ${EXPECTED_HITS} hits, ${MISSES} misses")
+    message(FATAL_ERROR "${NAME}: expected ${EXPECTED_STATUS} and ${EXPECTED_HITS} hits, got ${STATUS} and '${COUNTERS}'")
+  endif()
+endfunction()
+
+run_cache(STATUS COUNTERS)
+check_run("first run" "${STATUS}" "${COUNTERS}" ok 0)
+
+run_cache(STATUS COUNTERS)
+check_run("second run" "${STATUS}" "${COUNTERS}" cached 1)
+if(NOT EXISTS "${WORK_DIR}/out/cache.pdf")
+  message(FATAL_ERROR "cached document isn't copied to output directory")
+endif()
+
+# a Dompdf option is a part of the key
+run_cache(STATUS COUNTERS --dpi 150)
+check_run("run with another option" "${STATUS}" "${COUNTERS}" ok 0)
+
+# so is content of a local asset referenced by the document
+file(WRITE "${WORK_DIR}/in/cache.css" "p { color: red; }\n")
+run_cache(STATUS COUNTERS)
+check_run("run with changed style sheet" "${STATUS}" "${COUNTERS}" ok 0)
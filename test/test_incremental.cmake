@@ -0,0 +1,76 @@
+# Convert two documents with --incremental four times: the second run must skip both of them,
+# the third one convert only the document, which input was touched, and the fourth one, which changes
+# an option of the program affecting the output, both of them.
+# Variables: DOMPDFUI - path to executable, SOURCE_DIR - directory of test documents, WORK_DIR - directory of test
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}/in")
+file(COPY "${SOURCE_DIR}/test1.html" "${SOURCE_DIR}/test2.html" DESTINATION "${WORK_DIR}/in")
+set(REPORT "${WORK_DIR}/report.jsonl")
+
+# function convert documents and return status of each of them from report; further arguments are options
+function(run_incremental OUT)
+  file(REMOVE "${REPORT}")
+  execute_process(
+    COMMAND "${DOMPDFUI}" --no-clean --incremental --report "${REPORT}" ${ARGN}
+            "${WORK_DIR}/in/test1.html" "${WORK_DIR}/in/test2.html" "${WORK_DIR}/out"
+    RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "dompdfui failed\n${OUTPUT}")
+  endif()
+  file(STRINGS "${REPORT}" LINES)
+  set(STATUSES "")
+  foreach(LINE ${LINES})
+    string(JSON TYPE GET "${LINE}" "type")
+    if(TYPE STREQUAL "document")
+      string(JSON STATUS GET "${LINE}" "status")
+      list(APPEND STATUSES "${STATUS}")
+    endif()
+  endforeach()
+  set(${OUT} "${STATUSES}" PARENT_SCOPE)
+endfunction()
+
+# function check that output was rewritten by the last run or not
+function(check_rewritten NAME EXPECTED)
+  file(STRINGS "${WORK_DIR}/out/${NAME}.pdf" MARKER REGEX "^%not rewritten$")
+  if(MARKER AND EXPECTED)
+    message(FATAL_ERROR "${NAME}.pdf is not rewritten")
+  elseif(NOT MARKER AND NOT EXPECTED)
+    message(FATAL_ERROR "${NAME}.pdf is rewritten, though its input is unchanged")
+  endif()
+endfunction()
+
+run_incremental(STATUSES)
+if(NOT STATUSES STREQUAL "ok;ok")
+  message(FATAL_ERROR "first run: expected ok;ok, got ${STATUSES}")
+endif()
+
+# outputs are marked, so that rewriting them is seen regardless of resolution of file times
+foreach(NAME test1 test2)
+  file(APPEND "${WORK_DIR}/out/${NAME}.pdf" "\n%not rewritten\n")
+endforeach()
+run_incremental(STATUSES)
+if(NOT STATUSES STREQUAL "skipped;skipped")
+  message(FATAL_ERROR "second run: expected skipped;skipped, got ${STATUSES}")
+endif()
+check_rewritten(test1 FALSE)
+check_rewritten(test2 FALSE)
+
+file(TOUCH "${WORK_DIR}/in/test2.html")
+run_incremental(STATUSES)
+if(NOT STATUSES STREQUAL "skipped;ok")
+  message(FATAL_ERROR "third run: expected skipped;ok, got ${STATUSES}")
+endif()
+check_rewritten(test1 FALSE)
+check_rewritten(test2 TRUE)
+
+# --split-size changes the produced PDF, so documents converted without it are converted again
+foreach(NAME test1 test2)
+  file(APPEND "${WORK_DIR}/out/${NAME}.pdf" "\n%not rewritten\n")
+endforeach()
+run_incremental(STATUSES --split-size 100000000)
+if(NOT STATUSES STREQUAL "ok;ok")
+  message(FATAL_ERROR "fourth run: expected ok;ok, got ${STATUSES}")
+endif()
+check_rewritten(test1 TRUE)
+check_rewritten(test2 TRUE)
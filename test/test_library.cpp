@@ -0,0 +1,131 @@
+// test of libdompdfui: documents are converted in memory by converter, with options of converter and of job,
+// one by one and in batch, and failed conversion throws from future::get(); a converter with cache_dir and
+// split_size answers a repeated document from cache, and merges a large document from parts; a worker killed
+// by a fatal error of PHP fails the job with the message of PHP
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "dompdfui.h"
+
+namespace {
+
+int failures {};
+
+void check(bool condition, const std::string& message)
+{
+  if(condition) return;
+  std::cerr << "FAILED: " << message << '\n';
+  ++failures;
+}
+
+bool is_pdf(const std::vector<std::byte>& data)
+{
+  return data.size() > 4 && std::string_view(reinterpret_cast<const char*>(data.data()), 5) == "%PDF-";
+}
+
+// function return result of conversion, or empty vector and error message, if it failed
+std::vector<std::byte> result(std::future<std::vector<std::byte>>& f, std::string& error)
+{
+  try {
+    return f.get();
+  }
+  catch(const std::runtime_error& e) {
+    error = e.what();
+    return {};
+  }
+}
+
+} // namespace
+
+
+int main()
+{
+  const std::string_view good = "<html><body><p>Hello</p></body></html>";
+  const std::string_view table = "<html><body><table><tr><td>1</td><td>2</td></tr></table></body></html>";
+  // exception thrown by embedded PHP code fails the render
+  const std::string_view bad =
+    "<html><body><p>FAIL</p><script type=\"text/php\">throw new Exception('FAIL of test');</script></body></html>";
+
+  try {
+    dompdfui::Options options;
+    options.jobs = 2;
+    options.batch_size = 2;
+    dompdfui::converter converter(options);
+
+    auto job_options = options;
+    job_options.defaultPaperSize = "letter";
+    job_options.defaultPaperOrientation = "landscape";
+    job_options.isPhpEnabled = true;
+    std::string error;
+    auto one = converter.convert(good, job_options);
+    check(is_pdf(result(one, error)) && error.empty(), "convert(html, options) must return PDF: " + error);
+
+    auto batch = converter.convert({ good, bad, table }, job_options);
+    check(batch.size() == 3, "batch must return a future for each document");
+    std::vector<std::string> errors(batch.size());
+    std::vector<std::vector<std::byte>> pdfs;
+    for(size_t i=0; i<batch.size(); ++i) pdfs.push_back(result(batch[i], errors[i]));
+    check(is_pdf(pdfs[0]) && errors[0].empty(), "the first document of batch must be converted: " + errors[0]);
+    check(pdfs[1].empty() && !errors[1].empty(), "the second document of batch must fail");
+    check(is_pdf(pdfs[2]) && errors[2].empty(), "the third document of batch must be converted: " + errors[2]);
+
+    // options of converter are used without overrides, and workers survive failed jobs
+    auto last = converter.convert(good);
+    check(is_pdf(result(last, error)), "convert(html) must return PDF after failed job");
+
+    auto stats = converter.stats();
+    check(stats.done == 4 && stats.failed == 1, "statistics must count 4 done and 1 failed jobs, not "
+          + std::to_string(stats.done) + " and " + std::to_string(stats.failed));
+
+    dompdfui::set_option(job_options, "dpi", "150.5");
+    check(job_options.dpi == 150.5, "set_option must accept fractional dpi");
+    bool thrown {};
+    try {
+      dompdfui::set_option(job_options, "dpi", "abc");
+    }
+    catch(const std::runtime_error&) {
+      thrown = true;
+    }
+    check(thrown, "set_option must reject bad value");
+
+    std::string rows;
+    for(int i=0; i<400; ++i) rows += "<tr><td>row " + std::to_string(i) + "</td><td>value</td></tr>\n";
+    const std::string large = "<html><body><table>" + rows + "</table></body></html>";
+    auto cache_dir = std::filesystem::temp_directory_path() / "dompdfui_test_library_cache";
+    std::filesystem::remove_all(cache_dir);
+    auto processing_options = options;
+    processing_options.cache_dir = cache_dir.string();
+    processing_options.split_size = 4096;
+    {
+      dompdfui::converter processing(processing_options);
+      auto split = processing.convert(large);
+      check(is_pdf(result(split, error)) && error.empty(), "split document must be merged to PDF: " + error);
+      check(processing.stats().done > 1, "document larger than split_size must be converted in parts");
+      auto again = processing.convert(large);
+      check(is_pdf(result(again, error)) && error.empty(), "cached document must be returned: " + error);
+      check(processing.stats().cached == 1, "repeated document must be answered from cache");
+    }
+    std::filesystem::remove_all(cache_dir);
+
+    // fatal error of PHP, which kills the worker, is reported with its message
+    auto small_options = options;
+    small_options.jobs = 1;
+    small_options.php_memory_limit = 2 << 20;
+    {
+      dompdfui::converter small(small_options);
+      error.clear();
+      auto crashed = small.convert(good);
+      check(result(crashed, error).empty() && error.find("Allowed memory size") != error.npos,
+            "crash of worker must report error of PHP, not '" + error + "'");
+    }
+  }
+  catch(const std::exception& e) {
+    std::cerr << "FAILED: " << e.what() << '\n';
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+# Convert a document with --max-total-memory twice, starting without memory state and with a default limit
+# too small for Dompdf: the first run must retry the document with a larger limit, and record its peak memory
+# in the state file; the second one must read the state and convert the document at once with a limit
+# estimated from that peak.
+# Variables: DOMPDFUI - path to executable, SOURCE_DIR - directory of test documents, WORK_DIR - directory of test
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(REPORT "${WORK_DIR}/report.jsonl")
+set(STATE "${WORK_DIR}/memory.state")
+set(DEFAULT_LIMIT 2097152)
+
+# function convert the document, and return memory retries of the run, and status, peak memory
+# and memory limit of the document from report
+function(run_memory RETRIES_OUT STATUS_OUT PEAK_OUT LIMIT_OUT)
+  file(REMOVE "${REPORT}")
+  execute_process(
+    COMMAND "${DOMPDFUI}" --no-clean --force-out --jobs 1 --php-memory-limit ${DEFAULT_LIMIT}
+            --max-total-memory 1073741824 --memory-state "${STATE}" --report "${REPORT}"
+            "${SOURCE_DIR}/test2.html" "${WORK_DIR}/out"
+    RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "dompdfui failed\n${OUTPUT}")
+  endif()
+  file(STRINGS "${REPORT}" LINES)
+  foreach(LINE ${LINES})
+    string(JSON TYPE GET "${LINE}" "type")
+    if(TYPE STREQUAL "run")
+      string(JSON RETRIES GET "${LINE}" "memory_retries")
+    else()
+      string(JSON STATUS GET "${LINE}" "status")
+      string(JSON PEAK GET "${LINE}" "peak_memory")
+      string(JSON LIMIT GET "${LINE}" "process" "memory_limit")
+    endif()
+  endforeach()
+  set(${RETRIES_OUT} "${RETRIES}" PARENT_SCOPE)
+  set(${STATUS_OUT} "${STATUS}" PARENT_SCOPE)
+  set(${PEAK_OUT} "${PEAK}" PARENT_SCOPE)
+  set(${LIMIT_OUT} "${LIMIT}" PARENT_SCOPE)
+endfunction()
+
+run_memory(RETRIES STATUS PEAK LIMIT)
+if(NOT STATUS STREQUAL "ok" OR RETRIES LESS 1 OR NOT LIMIT GREATER DEFAULT_LIMIT)
+  message(FATAL_ERROR "first run: expected ok after a retry with a larger limit, got ${STATUS}, "
+                      "${RETRIES} retries, limit ${LIMIT}")
+endif()
+if(NOT PEAK GREATER DEFAULT_LIMIT)
+  message(FATAL_ERROR "first run: peak memory ${PEAK} isn't above the limit the document exceeded")
+endif()
+
+# state keeps the peak of the document
+file(STRINGS "${STATE}" STATE_LINES REGEX "test2\\.html$")
+list(LENGTH STATE_LINES COUNT)
+if(NOT COUNT EQUAL 1)
+  message(FATAL_ERROR "memory state has no entry of the document")
+endif()
+string(REGEX MATCH "^[0-9]+" RECORDED "${STATE_LINES}")
+if(NOT RECORDED GREATER DEFAULT_LIMIT)
+  message(FATAL_ERROR "memory state records peak ${RECORDED}, which isn't above the exceeded limit")
+endif()
+
+run_memory(RETRIES STATUS PEAK LIMIT)
+if(NOT STATUS STREQUAL "ok" OR NOT RETRIES EQUAL 0 OR NOT LIMIT GREATER RECORDED)
+  message(FATAL_ERROR "second run: expected ok without retries, with a limit above recorded peak ${RECORDED}, "
+                      "got ${STATUS}, ${RETRIES} retries, limit ${LIMIT}")
+endif()
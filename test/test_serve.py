@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Start dompdfui daemon, convert two documents by client mode of the same executable, check the
+# statistics of the daemon, its output cache, rejection of a document larger than --max-request-size,
+# of options the client doesn't apply and of standard input and output, and stop it by SIGTERM while
+# a client is connected: the daemon must exit with status 0 in time, and remove its socket.
+# Usage: test_serve.py DOMPDFUI SOURCE_DIR WORK_DIR
+
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+dompdfui, source_dir, work_dir = sys.argv[1], Path(sys.argv[2]), Path(sys.argv[3])
+shutil.rmtree(work_dir, ignore_errors=True)
+(work_dir / 'out').mkdir(parents=True)
+sock = work_dir / 'dompdfui.sock'
+
+
+def fail(message, daemon=None):
+    if daemon and daemon.poll() is None:
+        daemon.kill()
+    output = daemon.communicate()[0] if daemon else ''
+    sys.exit(message + ('\ndaemon output:\n' + output if output else ''))
+
+
+def client(*args):
+    return subprocess.run([dompdfui, '--client', str(sock)] + list(args), capture_output=True, text=True, timeout=120)
+
+
+daemon = subprocess.Popen([dompdfui, '--no-clean', '--jobs', '2', '--max-request-size', '1048576',
+                           '--cache-dir', str(work_dir / 'cache'), '--serve', str(sock)],
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+deadline = time.monotonic() + 60
+while not sock.exists():
+    if daemon.poll() is not None or time.monotonic() > deadline:
+        fail('daemon did not start listening', daemon)
+    time.sleep(0.1)
+
+r = client(str(source_dir / 'test1.html'), str(source_dir / 'test2.html'), str(work_dir / 'out'))
+if r.returncode:
+    fail('client failed:\n' + r.stdout + r.stderr, daemon)
+for name in ('test1', 'test2'):
+    pdf = work_dir / 'out' / (name + '.pdf')
+    if not pdf.exists() or not pdf.read_bytes().startswith(b'%PDF-'):
+        fail('%s is not converted by daemon' % pdf, daemon)
+
+r = client()
+if r.returncode or 'done=2' not in r.stdout or 'failed=0' not in r.stdout:
+    fail('unexpected statistics of daemon: ' + r.stdout + r.stderr, daemon)
+
+# the same document is answered from --cache-dir of the daemon
+(work_dir / 'again').mkdir()
+r = client(str(source_dir / 'test1.html'), str(work_dir / 'again'))
+if r.returncode or not (work_dir / 'again' / 'test1.pdf').read_bytes().startswith(b'%PDF-'):
+    fail('client failed to convert document again:\n' + r.stdout + r.stderr, daemon)
+r = client()
+if r.returncode or 'done=2' not in r.stdout or 'cached=1' not in r.stdout:
+    fail('document is not answered from output cache: ' + r.stdout + r.stderr, daemon)
+
+# options, which the client doesn't apply, are rejected
+r = client('--report', str(work_dir / 'report.json'), str(source_dir / 'test1.html'), str(work_dir / 'again'))
+if r.returncode == 0 or "can't be used with 'client'" not in r.stderr:
+    fail('--report is not rejected by client: ' + r.stdout + r.stderr, daemon)
+for args in ([str(source_dir / 'test1.html'), '-'], ['-', '-']):
+    r = client(*args)
+    if r.returncode == 0 or "can't be used with 'client'" not in r.stderr or Path('-').exists():
+        fail('standard input or output is not rejected by client: ' + r.stdout + r.stderr, daemon)
+
+# the daemon replies before reading a document over the limit
+with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+    s.connect(str(sock))
+    s.sendall(b'RENDER 0 2097152\n')
+    s.settimeout(60)
+    reply = b''
+    while chunk := s.recv(4096):
+        reply += chunk
+if not reply.startswith(b'ERROR ') or b'max-request-size' not in reply:
+    fail('unexpected reply to a document over --max-request-size: %r' % reply, daemon)
+
+# an idle connection must not keep the daemon from stopping
+idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+idle.connect(str(sock))
+daemon.send_signal(signal.SIGTERM)
+try:
+    output = daemon.communicate(timeout=60)[0]
+except subprocess.TimeoutExpired:
+    fail('daemon did not stop on SIGTERM', daemon)
+idle.close()
+if daemon.returncode != 0:
+    sys.exit('daemon exited with status %d:\n%s' % (daemon.returncode, output))
+if sock.exists():
+    sys.exit('daemon did not remove its socket')
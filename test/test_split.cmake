@@ -0,0 +1,64 @@
+# Convert a document of six sections, each starting on a new page, whole and with --split-size: the document
+# must be split to several parts, and the merged file must have the same six pages as the whole one, and keep
+# its named destinations.
+# Variables: DOMPDFUI - path to executable, WORK_DIR - directory of test
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(HTML "<html><head><style>h1 { font-size: 20px; }</style></head><body>\n")
+foreach(I RANGE 1 6)
+  math(EXPR NEXT "${I} % 6 + 1")
+  set(BREAK "")
+  if(I GREATER 1)
+    set(BREAK " style=\"page-break-before: always\"")
+  endif()
+  string(APPEND HTML "<div id=\"s${I}\"${BREAK}><h1>Section ${I}</h1>"
+                     "<p>Text of section ${I}, which links to <a href=\"#s${NEXT}\">section ${NEXT}</a>.</p></div>\n")
+endforeach()
+string(APPEND HTML "</body></html>\n")
+file(WRITE "${WORK_DIR}/split.html" "${HTML}")
+
+# function convert the document to directory; further arguments are options
+function(run_split DIR OUT)
+  execute_process(
+    COMMAND "${DOMPDFUI}" --no-clean --force-out ${ARGN} "${WORK_DIR}/split.html" "${WORK_DIR}/${DIR}"
+    RESULT_VARIABLE RESULT OUTPUT_VARIABLE OUTPUT ERROR_VARIABLE OUTPUT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "dompdfui failed\n${OUTPUT}")
+  endif()
+  set(${OUT} "${OUTPUT}" PARENT_SCOPE)
+endfunction()
+
+# function return number of page objects of PDF file
+function(count_pages FILE OUT)
+  file(READ "${FILE}" HEADER LIMIT 8)
+  if(NOT HEADER MATCHES "^%PDF-")
+    message(FATAL_ERROR "${FILE} isn't a PDF file")
+  endif()
+  file(STRINGS "${FILE}" PAGES REGEX "/Type */Page([^s]|$)")
+  list(LENGTH PAGES COUNT)
+  set(${OUT} ${COUNT} PARENT_SCOPE)
+endfunction()
+
+run_split(whole OUTPUT)
+count_pages("${WORK_DIR}/whole/split.pdf" WHOLE_PAGES)
+if(NOT WHOLE_PAGES EQUAL 6)
+  message(FATAL_ERROR "whole document: expected 6 pages, got ${WHOLE_PAGES}")
+endif()
+
+run_split(split OUTPUT --split-size 256)
+string(REGEX MATCH "Split 1 documents to ([0-9]+) parts" SPLIT "${OUTPUT}")
+if(NOT SPLIT OR CMAKE_MATCH_1 LESS 2)
+  message(FATAL_ERROR "document isn't split to parts\n${OUTPUT}")
+endif()
+count_pages("${WORK_DIR}/split/split.pdf" MERGED_PAGES)
+if(NOT MERGED_PAGES EQUAL WHOLE_PAGES)
+  message(FATAL_ERROR "merged document: expected ${WHOLE_PAGES} pages, got ${MERGED_PAGES}")
+endif()
+
+# named destinations of sections, in /Dests dictionary or name tree, are merged from all parts
+file(STRINGS "${WORK_DIR}/whole/split.pdf" WHOLE_DESTS REGEX "/Dests")
+file(STRINGS "${WORK_DIR}/split/split.pdf" MERGED_DESTS REGEX "/s6 |\\(s6\\)")
+if(WHOLE_DESTS AND NOT MERGED_DESTS)
+  message(FATAL_ERROR "named destination of the last part isn't kept in merged document")
+endif()